@@ -0,0 +1,101 @@
+#include "access_pattern.hpp"
+#include "symbols.hpp"
+#include <algorithm>
+#include <vector>
+
+#define MAX_REPORTED_PCS 10
+
+static const char *pattern_names[PATTERN_COUNT] = {"constant", "unit_stride", "fixed_stride", "irregular"};
+
+
+PatternCounters::PatternCounters(){
+	clear();
+}
+
+
+void PatternCounters::merge(const PatternCounters &other){
+	for(int pattern = 0; pattern < PATTERN_COUNT; pattern++)
+		bytes[pattern] += other.bytes[pattern];
+	for(auto &pc : other.irregular_pcs)
+		irregular_pcs[pc.first] += pc.second;
+}
+
+
+void PatternCounters::scale(double factor){
+	for(int pattern = 0; pattern < PATTERN_COUNT; pattern++)
+		bytes[pattern] = (unsigned long long)(bytes[pattern] * factor + 0.5);
+	for(auto &pc : irregular_pcs)
+		pc.second = (unsigned long long)(pc.second * factor + 0.5);
+}
+
+
+void PatternCounters::clear(void){
+	for(int pattern = 0; pattern < PATTERN_COUNT; pattern++)
+		bytes[pattern] = 0;
+	irregular_pcs.clear();
+}
+
+
+void PatternCounters::dump(file_t out_file){
+	dr_fprintf(out_file, "<access_patterns>\n");
+	for(int pattern = 0; pattern < PATTERN_COUNT; pattern++)
+		dr_fprintf(out_file, "<%s_bytes>%llu</%s_bytes>\n", pattern_names[pattern], bytes[pattern], pattern_names[pattern]);
+
+	std::vector<std::pair<app_pc, unsigned long long>> pcs(irregular_pcs.begin(), irregular_pcs.end());
+	std::sort(pcs.begin(), pcs.end(),
+			[](const std::pair<app_pc, unsigned long long> &a, const std::pair<app_pc, unsigned long long> &b){
+				return a.second > b.second; });
+	for(size_t i = 0; i < pcs.size() && i < MAX_REPORTED_PCS; i++){
+		std::string function, src;
+		lookup_pc_symbol(pcs[i].first, &function, &src);
+		dr_fprintf(out_file, "<irregular_pc address=\"" PFX "\" function=\"%s\" src=\"%s\">%llu</irregular_pc>\n",
+				pcs[i].first, xml_escape(function).c_str(), xml_escape(src).c_str(), pcs[i].second);
+	}
+	dr_fprintf(out_file, "</access_patterns>\n");
+}
+
+
+void AccessPatterns::access(app_pc pc, app_pc addr, unsigned int size){
+	auto it = streams.find(pc);
+	if(it == streams.end()){
+		streams.emplace(pc, instr_stream_t{(ptr_int_t)addr, 0, size, {0, 0, 0, 0}});
+		return;
+	}
+	instr_stream_t &stream = it->second;
+	ptr_int_t delta = (ptr_int_t)addr - stream.last_addr;
+	int pattern;
+	if(delta == 0)
+		pattern = PATTERN_CONSTANT;
+	else if(delta == (ptr_int_t)size || delta == -(ptr_int_t)size)
+		pattern = PATTERN_UNIT_STRIDE;
+	else if(delta == stream.last_delta)
+		pattern = PATTERN_FIXED_STRIDE;
+	else
+		pattern = PATTERN_IRREGULAR;
+	stream.votes[pattern]++;
+	stream.last_addr = (ptr_int_t)addr;
+	stream.last_delta = delta;
+	stream.bytes += size;
+}
+
+
+void AccessPatterns::save(PatternCounters &to){
+	for(auto &entry : streams){
+		instr_stream_t &stream = entry.second;
+		// An instruction executed once accessed a single address
+		int pattern = PATTERN_CONSTANT;
+		for(int candidate = PATTERN_CONSTANT + 1; candidate < PATTERN_COUNT; candidate++){
+			if(stream.votes[candidate] > stream.votes[pattern])
+				pattern = candidate;
+		}
+		to.bytes[pattern] += stream.bytes;
+		if(pattern == PATTERN_IRREGULAR)
+			to.irregular_pcs[entry.first] += stream.bytes;
+	}
+	streams.clear();
+}
+
+
+void AccessPatterns::clear(void){
+	streams.clear();
+}
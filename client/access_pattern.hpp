@@ -0,0 +1,64 @@
+#ifndef ACCESS_PATTERN_H
+#define ACCESS_PATTERN_H
+
+
+#include "dr_api.h"
+#include <map>
+#include <unordered_map>
+
+/* Memory access pattern classification (--access_patterns).
+ * Each thread follows the address stream of every memory instruction within the ROI:
+ * each access votes for a pattern given its distance (delta) from the previous access of the
+ * same instruction:
+ * - constant: delta 0;
+ * - unit stride: delta of plus or minus the access size, i.e. contiguous accesses;
+ * - fixed stride: the same delta as the previous one;
+ * - irregular: anything else.
+ * When the ROI ends, each instruction is given the pattern most of its accesses voted for, and its
+ * bytes are added to that pattern. Bytes of the irregular instructions are kept per pc as well.
+ * */
+
+enum {
+	PATTERN_CONSTANT,
+	PATTERN_UNIT_STRIDE,
+	PATTERN_FIXED_STRIDE,
+	PATTERN_IRREGULAR,
+	PATTERN_COUNT,
+};
+
+// The patterns of a ROI
+class PatternCounters{
+public:
+  PatternCounters();
+  unsigned long long bytes[PATTERN_COUNT];
+  // Bytes accessed by each irregular instruction
+  std::map<app_pc, unsigned long long> irregular_pcs;
+
+  void merge(const PatternCounters &other);
+  void scale(double factor);
+  void clear(void);
+  // Writes the bytes per pattern, and the irregular instructions accessing the most bytes
+  void dump(file_t out_file);
+};
+
+
+class AccessPatterns{
+public:
+  void access(app_pc pc, app_pc addr, unsigned int size);
+  // Classifies the instructions followed so far, moving their bytes into the given counters
+  void save(PatternCounters &to);
+  void clear(void);
+
+private:
+  typedef struct _instr_stream_t {
+    ptr_int_t last_addr;
+    ptr_int_t last_delta;
+    unsigned long long bytes;
+    unsigned long long votes[PATTERN_COUNT];
+  } instr_stream_t;
+
+  std::unordered_map<app_pc, instr_stream_t> streams;
+};
+
+
+#endif
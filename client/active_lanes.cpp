@@ -0,0 +1,171 @@
+#include "active_lanes.hpp"
+#include "fp_table.hpp"
+
+
+reg_id_t get_governing_reg(instr_t *instr){
+	for(int i = 0; i < instr_num_srcs(instr); i++){
+		opnd_t opnd = instr_get_src(instr, i);
+		if(!opnd_is_reg(opnd))
+			continue;
+		reg_id_t reg = opnd_get_reg(opnd);
+#ifdef X86
+		if(reg_is_opmask(reg) && reg != DR_REG_K0)
+			return reg;
+#else
+		if(reg >= DR_REG_P0 && reg <= DR_REG_P15)
+			return reg;
+#endif
+	}
+	return DR_REG_NULL;
+}
+
+
+static bool accesses_memory(instr_t *instr){
+	return instr_reads_memory(instr) || instr_writes_memory(instr);
+}
+
+
+#ifdef X86
+// Size of the widest SIMD register operand: the vector the mask bits map to
+static uint vector_bytes(instr_t *instr){
+	uint widest = 0;
+	for(int i = 0; i < instr_num_srcs(instr) + instr_num_dsts(instr); i++){
+		opnd_t opnd = i < instr_num_srcs(instr) ? instr_get_src(instr, i) : instr_get_dst(instr, i - instr_num_srcs(instr));
+		if(!opnd_is_reg(opnd) || !reg_is_simd(opnd_get_reg(opnd)))
+			continue;
+		uint size = opnd_size_in_bytes(reg_get_size(opnd_get_reg(opnd)));
+		if(size > widest)
+			widest = size;
+	}
+	return widest;
+}
+
+
+static uint mem_opnd_bytes(instr_t *instr){
+	for(int i = 0; i < instr_num_srcs(instr) + instr_num_dsts(instr); i++){
+		opnd_t opnd = i < instr_num_srcs(instr) ? instr_get_src(instr, i) : instr_get_dst(instr, i - instr_num_srcs(instr));
+		if(opnd_is_memory_reference(opnd))
+			return opnd_size_in_bytes(opnd_get_size(opnd));
+	}
+	return 0;
+}
+
+
+// Element width of the masked moves, whose opcode isn't a FP one
+static uint masked_move_elem_bytes(int opcode){
+	switch(opcode){
+		case OP_vmovdqu8:
+			return 1;
+		case OP_vmovdqu16:
+			return 2;
+		case OP_vmovups: case OP_vmovaps: case OP_vmovdqu32: case OP_vmovdqa32:
+			return 4;
+		case OP_vmovupd: case OP_vmovapd: case OP_vmovdqu64: case OP_vmovdqa64:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+
+bool get_masked_fp_lanes(instr_t *instr, masked_lanes_t *lanes){
+	fp_op_t op = get_fp_op(instr_get_opcode(instr));
+	reg_id_t mask = get_governing_reg(instr);
+	if(op.ops == 0 || mask == DR_REG_NULL)
+		return false;
+	// Scalar instructions (e.g. vaddss with a mask) have a single lane: the lowest mask bit
+	uint lane_count = op.elem_bytes > 0 ? vector_bytes(instr) / op.elem_bytes : 1;
+	*lanes = masked_lanes_t{mask, lane_count > 0 ? lane_count : 1, op.elem_bytes, 0, op.ops};
+	return true;
+}
+
+
+bool get_masked_mem_lanes(instr_t *instr, masked_lanes_t *lanes){
+	reg_id_t mask = get_governing_reg(instr);
+	if(mask == DR_REG_NULL || !accesses_memory(instr) || instr_is_gather(instr) || instr_is_scatter(instr))
+		return false;
+	fp_op_t op = get_fp_op(instr_get_opcode(instr));
+	uint elem_bytes = op.elem_bytes > 0 ? op.elem_bytes : masked_move_elem_bytes(instr_get_opcode(instr));
+	uint vector = vector_bytes(instr);
+	// A broadcast or scalar memory operand is accessed whatever the mask, as its static size says
+	if(elem_bytes == 0 || vector == 0 || mem_opnd_bytes(instr) != vector)
+		return false;
+	*lanes = masked_lanes_t{mask, vector / elem_bytes, elem_bytes, elem_bytes, 0};
+	return true;
+}
+
+#else
+
+static bool is_z_reg(reg_id_t reg){
+	return reg >= DR_REG_Z0 && reg <= DR_REG_Z31;
+}
+
+
+// Element size of the first Z register operand: the lane width the predicate is read with
+static uint sve_lane_bytes(instr_t *instr){
+	for(int i = 0; i < instr_num_dsts(instr) + instr_num_srcs(instr); i++){
+		opnd_t opnd = i < instr_num_dsts(instr) ? instr_get_dst(instr, i) : instr_get_src(instr, i - instr_num_dsts(instr));
+		if(opnd_is_reg(opnd) && is_z_reg(opnd_get_reg(opnd)))
+			return opnd_size_in_bytes(opnd_get_vector_element_size(opnd));
+	}
+	return 0;
+}
+
+
+// Bytes each active element of the contiguous SVE loads and stores accesses in memory,
+// which the extending loads and truncating stores make narrower than the register elements
+static uint sve_mem_elem_bytes(int opcode){
+	switch(opcode){
+		case OP_ld1b: case OP_ld1sb: case OP_ldff1b: case OP_ldff1sb: case OP_ldnf1b: case OP_ldnf1sb:
+		case OP_ldnt1b: case OP_st1b: case OP_stnt1b:
+			return 1;
+		case OP_ld1h: case OP_ld1sh: case OP_ldff1h: case OP_ldff1sh: case OP_ldnf1h: case OP_ldnf1sh:
+		case OP_ldnt1h: case OP_st1h: case OP_stnt1h:
+			return 2;
+		case OP_ld1w: case OP_ld1sw: case OP_ldff1w: case OP_ldff1sw: case OP_ldnf1w: case OP_ldnf1sw:
+		case OP_ldnt1w: case OP_st1w: case OP_stnt1w:
+			return 4;
+		case OP_ld1d: case OP_ldff1d: case OP_ldnf1d: case OP_ldnt1d: case OP_st1d: case OP_stnt1d:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+
+bool get_masked_fp_lanes(instr_t *instr, masked_lanes_t *lanes){
+	fp_op_t op = get_fp_op(instr_get_opcode(instr));
+	reg_id_t pred = get_governing_reg(instr);
+	uint lane_bytes = sve_lane_bytes(instr);
+	if(op.ops == 0 || pred == DR_REG_NULL || lane_bytes == 0)
+		return false;
+	// Predicated reductions count one operation per active lane, not one less
+	*lanes = masked_lanes_t{pred, 0, lane_bytes, 0, op.ops};
+	return true;
+}
+
+
+bool get_masked_mem_lanes(instr_t *instr, masked_lanes_t *lanes){
+	reg_id_t pred = get_governing_reg(instr);
+	if(pred == DR_REG_NULL || !accesses_memory(instr) || instr_is_gather(instr) || instr_is_scatter(instr))
+		return false;
+	uint elem_bytes = sve_mem_elem_bytes(instr_get_opcode(instr));
+	uint lane_bytes = sve_lane_bytes(instr);
+	if(elem_bytes == 0)
+		return false;
+	*lanes = masked_lanes_t{pred, 0, lane_bytes > 0 ? lane_bytes : elem_bytes, elem_bytes, 0};
+	return true;
+}
+#endif
+
+
+bool is_masked_fp_instr(instr_t *instr){
+	masked_lanes_t lanes;
+	return get_masked_fp_lanes(instr, &lanes);
+}
+
+
+bool is_masked_mem_instr(instr_t *instr){
+	masked_lanes_t lanes;
+	return get_masked_mem_lanes(instr, &lanes);
+}
@@ -0,0 +1,36 @@
+#ifndef ACTIVE_LANES_H
+#define ACTIVE_LANES_H
+
+
+#include "dr_api.h"
+
+/* Masked (AVX-512) and predicated (SVE) vector instructions.
+ * Their work depends on the lanes enabled by their governing opmask or predicate register, only
+ * known at runtime: the static counts of their block leave them out, and inline code counts
+ * the active lanes right before they execute (see runtime_bytes.hpp).
+ * This file only classifies decoded instructions, it doesn't instrument anything: it can be
+ * checked on encoded instructions, without executing them (see testing/fp_counter).
+ * */
+
+typedef struct _masked_lanes_t {
+	reg_id_t mask;         // Governing opmask (k1-k7) or predicate (p0-p15)
+	uint lanes;            // Lanes of the vector (AVX-512), 0 when the predicate counts them (SVE)
+	uint lane_bytes;       // Width of a lane, as the predicate sees it (SVE)
+	uint elem_bytes;       // Memory instructions: bytes accessed per active lane
+	uint ops;              // FP instructions: operations per active lane
+} masked_lanes_t;
+
+// Opmask (but k0, meaning no mask) or governing predicate of the instruction, DR_REG_NULL if none
+reg_id_t get_governing_reg(instr_t *instr);
+
+// Whether the FP operations of the instruction depend on its active lanes, and how
+bool get_masked_fp_lanes(instr_t *instr, masked_lanes_t *lanes);
+bool is_masked_fp_instr(instr_t *instr);
+
+// Whether the bytes a contiguous vector load or store accesses depend on its active lanes, and how.
+// Gathers and scatters are not included: they have their own handling.
+bool get_masked_mem_lanes(instr_t *instr, masked_lanes_t *lanes);
+bool is_masked_mem_instr(instr_t *instr);
+
+
+#endif
@@ -0,0 +1,87 @@
+#include "alignment.hpp"
+#include "symbols.hpp"
+#include <algorithm>
+#include <vector>
+
+#define MAX_REPORTED_PCS 10
+
+
+AlignmentCounters::AlignmentCounters(){
+	clear();
+}
+
+
+void AlignmentCounters::add(app_pc pc, app_pc addr, unsigned int size){
+	if(size == 0)
+		return;
+	// Largest power of two dividing the size
+	ptr_uint_t alignment = size & (~size + 1);
+	bool is_misaligned = ((ptr_uint_t)addr & (alignment - 1)) != 0;
+	ptr_uint_t lines = (((ptr_uint_t)addr + size - 1) >> ALIGNMENT_LINE_SHIFT) - ((ptr_uint_t)addr >> ALIGNMENT_LINE_SHIFT);
+	if(!is_misaligned && lines == 0)
+		return;
+	offender_t &offender = offenders[pc];
+	if(is_misaligned){
+		misaligned++;
+		offender.misaligned++;
+	}
+	if(lines > 0){
+		splits++;
+		extra_lines += lines;
+		offender.splits++;
+	}
+}
+
+
+void AlignmentCounters::merge(const AlignmentCounters &other){
+	misaligned += other.misaligned;
+	splits += other.splits;
+	extra_lines += other.extra_lines;
+	for(auto &pc : other.offenders){
+		offender_t &offender = offenders[pc.first];
+		offender.misaligned += pc.second.misaligned;
+		offender.splits += pc.second.splits;
+	}
+}
+
+
+void AlignmentCounters::scale(double factor){
+	misaligned = (unsigned long long)(misaligned * factor + 0.5);
+	splits = (unsigned long long)(splits * factor + 0.5);
+	extra_lines = (unsigned long long)(extra_lines * factor + 0.5);
+	for(auto &pc : offenders){
+		pc.second.misaligned = (unsigned long long)(pc.second.misaligned * factor + 0.5);
+		pc.second.splits = (unsigned long long)(pc.second.splits * factor + 0.5);
+	}
+}
+
+
+void AlignmentCounters::clear(void){
+	misaligned = 0;
+	splits = 0;
+	extra_lines = 0;
+	offenders.clear();
+}
+
+
+void AlignmentCounters::dump(file_t out_file){
+	dr_fprintf(out_file, "<alignment line_size=\"%u\">\n", 1U << ALIGNMENT_LINE_SHIFT);
+	dr_fprintf(out_file, "<misaligned>%llu</misaligned>\n", misaligned);
+	dr_fprintf(out_file, "<line_splits>%llu</line_splits>\n", splits);
+	dr_fprintf(out_file, "<extra_lines>%llu</extra_lines>\n", extra_lines);
+
+	// Line splits cost bandwidth, misaligned accesses within a line hardly ever do
+	std::vector<std::pair<app_pc, offender_t>> pcs(offenders.begin(), offenders.end());
+	std::sort(pcs.begin(), pcs.end(),
+			[](const std::pair<app_pc, offender_t> &a, const std::pair<app_pc, offender_t> &b){
+				return a.second.splits != b.second.splits ? a.second.splits > b.second.splits
+						: a.second.misaligned > b.second.misaligned; });
+	for(size_t i = 0; i < pcs.size() && i < MAX_REPORTED_PCS; i++){
+		std::string function, src;
+		lookup_pc_symbol(pcs[i].first, &function, &src);
+		dr_fprintf(out_file, "<offending_pc address=\"" PFX "\" function=\"%s\" src=\"%s\" misaligned=\"%llu\" line_splits=\"%llu\"/>\n",
+				pcs[i].first, xml_escape(function).c_str(), xml_escape(src).c_str(),
+				pcs[i].second.misaligned, pcs[i].second.splits);
+	}
+	dr_fprintf(out_file, "</alignment>\n");
+}
@@ -0,0 +1,39 @@
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+
+#include "dr_api.h"
+#include <map>
+
+/* Misaligned and cache line split accesses (--alignment).
+ * An access is misaligned when its address is not a multiple of its natural alignment: its size,
+ * or the largest power of two dividing it. It splits when it spans more than one 64 bytes line,
+ * costing an extra line (or more) to the memory subsystem. Offending instructions are kept per pc.
+ * */
+
+#define ALIGNMENT_LINE_SHIFT 6
+
+class AlignmentCounters{
+public:
+  AlignmentCounters();
+  unsigned long long misaligned;
+  unsigned long long splits;
+  unsigned long long extra_lines; // Lines touched on top of one per access
+
+  void add(app_pc pc, app_pc addr, unsigned int size);
+  void merge(const AlignmentCounters &other);
+  void scale(double factor);
+  void clear(void);
+  // Writes the counters, and the instructions splitting lines the most
+  void dump(file_t out_file);
+
+private:
+  typedef struct _offender_t {
+    unsigned long long misaligned;
+    unsigned long long splits;
+  } offender_t;
+  std::map<app_pc, offender_t> offenders;
+};
+
+
+#endif
@@ -0,0 +1,329 @@
+#include "allocations.hpp"
+#include "symbols.hpp"
+#include "drmgr.h"
+#include "drwrap.h"
+#include <atomic>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+typedef struct _live_block_t {
+	ptr_uint_t end;
+	int site;
+} live_block_t;
+
+typedef struct _allocation_site_t {
+	app_pc caller;
+	unsigned long long allocations;
+	unsigned long long max_size;
+} allocation_site_t;
+
+// Interval index of the live blocks and the allocation sites, shared by all the threads
+static std::map<ptr_uint_t, live_block_t> live_blocks;
+static std::vector<allocation_site_t> allocation_sites;
+static std::unordered_map<app_pc, int> site_ids;
+static void *allocations_lock;
+// Bumped whenever a block is freed: the blocks cached by the threads may not be live anymore
+static std::atomic<unsigned long long> generation(0);
+
+// Per-thread state of the wrapped call in progress
+typedef struct _allocator_call_t {
+	int depth;              // Allocator calls in progress: only the outermost one is tracked
+	size_t size;
+	app_pc caller;
+	void **memptr;          // posix_memalign
+} allocator_call_t;
+static int call_tls_idx;
+
+
+static void event_thread_init(void *drcontext){
+	allocator_call_t *call = (allocator_call_t*)dr_thread_alloc(drcontext, sizeof(allocator_call_t));
+	memset(call, 0, sizeof(*call));
+	drmgr_set_tls_field(drcontext, call_tls_idx, call);
+}
+
+
+static void event_thread_exit(void *drcontext){
+	dr_thread_free(drcontext, drmgr_get_tls_field(drcontext, call_tls_idx), sizeof(allocator_call_t));
+}
+
+
+void allocations_init(void){
+	allocations_lock = dr_mutex_create();
+	call_tls_idx = drmgr_register_tls_field();
+	DR_ASSERT_MSG(call_tls_idx != -1, "> ERROR: Couldn't allocate the allocations TLS field\n");
+	if(!drmgr_register_thread_init_event(event_thread_init) || !drmgr_register_thread_exit_event(event_thread_exit))
+		DR_ASSERT_MSG(false, "> ERROR: Couldn't register the allocations thread events\n");
+}
+
+
+void allocations_exit(void){
+	drmgr_unregister_thread_init_event(event_thread_init);
+	drmgr_unregister_thread_exit_event(event_thread_exit);
+	drmgr_unregister_tls_field(call_tls_idx);
+	dr_mutex_destroy(allocations_lock);
+}
+
+
+static void add_block(app_pc start, size_t size, app_pc caller){
+	if(start == NULL)
+		return;
+	dr_mutex_lock(allocations_lock);
+	int site;
+	auto it = site_ids.find(caller);
+	if(it != site_ids.end())
+		site = it->second;
+	else{
+		site = allocation_sites.size();
+		site_ids[caller] = site;
+		allocation_sites.push_back(allocation_site_t{caller, 0, 0});
+	}
+	allocation_sites[site].allocations++;
+	if(size > allocation_sites[site].max_size)
+		allocation_sites[site].max_size = size;
+	// Zero sized blocks still get a byte, so that they are found
+	live_blocks[(ptr_uint_t)start] = live_block_t{(ptr_uint_t)start + (size > 0 ? size : 1), site};
+	dr_mutex_unlock(allocations_lock);
+}
+
+
+static void remove_block(app_pc start){
+	if(start == NULL)
+		return;
+	dr_mutex_lock(allocations_lock);
+	if(live_blocks.erase((ptr_uint_t)start) > 0)
+		generation++;
+	dr_mutex_unlock(allocations_lock);
+}
+
+
+// Enters a wrapped allocator call: whether it is the outermost one
+static allocator_call_t *enter_call(void *wrapcxt, bool *outermost){
+	allocator_call_t *call = (allocator_call_t*)drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), call_tls_idx);
+	call->depth++;
+	*outermost = call->depth == 1;
+	if(*outermost)
+		call->caller = drwrap_get_retaddr(wrapcxt);
+	return call;
+}
+
+
+// Leaves a wrapped allocator call: whether it was the outermost one, which completed normally
+static allocator_call_t *leave_call(void *wrapcxt, bool *outermost){
+	allocator_call_t *call = (allocator_call_t*)drmgr_get_tls_field(dr_get_current_drcontext(), call_tls_idx);
+	*outermost = call->depth == 1 && wrapcxt != NULL;
+	if(call->depth > 0)
+		call->depth--;
+	return call;
+}
+
+
+static void pre_malloc(void *wrapcxt, OUT void **user_data){
+	bool outermost;
+	allocator_call_t *call = enter_call(wrapcxt, &outermost);
+	if(outermost)
+		call->size = (size_t)drwrap_get_arg(wrapcxt, 0);
+}
+
+
+// aligned_alloc(alignment, size)
+static void pre_aligned_alloc(void *wrapcxt, OUT void **user_data){
+	bool outermost;
+	allocator_call_t *call = enter_call(wrapcxt, &outermost);
+	if(outermost)
+		call->size = (size_t)drwrap_get_arg(wrapcxt, 1);
+}
+
+
+static void pre_calloc(void *wrapcxt, OUT void **user_data){
+	bool outermost;
+	allocator_call_t *call = enter_call(wrapcxt, &outermost);
+	if(outermost)
+		call->size = (size_t)drwrap_get_arg(wrapcxt, 0) * (size_t)drwrap_get_arg(wrapcxt, 1);
+}
+
+
+// The old block is dropped right away: if realloc fails, its traffic goes unattributed
+static void pre_realloc(void *wrapcxt, OUT void **user_data){
+	bool outermost;
+	allocator_call_t *call = enter_call(wrapcxt, &outermost);
+	if(outermost){
+		remove_block((app_pc)drwrap_get_arg(wrapcxt, 0));
+		call->size = (size_t)drwrap_get_arg(wrapcxt, 1);
+	}
+}
+
+
+// Returning the new block: malloc, calloc, realloc, aligned_alloc, operator new
+static void post_allocation(void *wrapcxt, void *user_data){
+	bool outermost;
+	allocator_call_t *call = leave_call(wrapcxt, &outermost);
+	if(outermost)
+		add_block((app_pc)drwrap_get_retval(wrapcxt), call->size, call->caller);
+}
+
+
+// posix_memalign(memptr, alignment, size)
+static void pre_posix_memalign(void *wrapcxt, OUT void **user_data){
+	bool outermost;
+	allocator_call_t *call = enter_call(wrapcxt, &outermost);
+	if(outermost){
+		call->memptr = (void**)drwrap_get_arg(wrapcxt, 0);
+		call->size = (size_t)drwrap_get_arg(wrapcxt, 2);
+	}
+}
+
+
+static void post_posix_memalign(void *wrapcxt, void *user_data){
+	bool outermost;
+	allocator_call_t *call = leave_call(wrapcxt, &outermost);
+	if(!outermost || drwrap_get_retval(wrapcxt) != 0)
+		return;
+	void *block;
+	if(dr_safe_read(call->memptr, sizeof(block), &block, NULL))
+		add_block((app_pc)block, call->size, call->caller);
+}
+
+
+// free and operator delete
+static void pre_free(void *wrapcxt, OUT void **user_data){
+	bool outermost;
+	enter_call(wrapcxt, &outermost);
+	if(outermost)
+		remove_block((app_pc)drwrap_get_arg(wrapcxt, 0));
+}
+
+
+static void post_free(void *wrapcxt, void *user_data){
+	bool outermost;
+	leave_call(wrapcxt, &outermost);
+}
+
+
+typedef struct _allocator_t {
+	const char *name;
+	void (*pre)(void *wrapcxt, OUT void **user_data);
+	void (*post)(void *wrapcxt, void *user_data);
+} allocator_t;
+
+static const allocator_t allocators[] = {
+	{"malloc", pre_malloc, post_allocation},
+	{"calloc", pre_calloc, post_allocation},
+	{"realloc", pre_realloc, post_allocation},
+	{"aligned_alloc", pre_aligned_alloc, post_allocation},
+	{"memalign", pre_aligned_alloc, post_allocation},
+	{"posix_memalign", pre_posix_memalign, post_posix_memalign},
+	{"free", pre_free, post_free},
+	{"_Znwm", pre_malloc, post_allocation},     // operator new(size_t)
+	{"_Znam", pre_malloc, post_allocation},     // operator new[](size_t)
+	{"_ZdlPv", pre_free, post_free},            // operator delete(void*)
+	{"_ZdaPv", pre_free, post_free},            // operator delete[](void*)
+	{"_ZdlPvm", pre_free, post_free},           // operator delete(void*, size_t)
+	{"_ZdaPvm", pre_free, post_free},           // operator delete[](void*, size_t)
+	{"_ZnwmSt11align_val_t", pre_malloc, post_allocation},  // operator new(size_t, align_val_t)
+	{"_ZnamSt11align_val_t", pre_malloc, post_allocation},  // operator new[](size_t, align_val_t)
+	{"_ZdlPvSt11align_val_t", pre_free, post_free},         // operator delete(void*, align_val_t)
+	{"_ZdaPvSt11align_val_t", pre_free, post_free},         // operator delete[](void*, align_val_t)
+	{"_ZdlPvmSt11align_val_t", pre_free, post_free},        // operator delete(void*, size_t, align_val_t)
+	{"_ZdaPvmSt11align_val_t", pre_free, post_free},        // operator delete[](void*, size_t, align_val_t)
+};
+
+
+void allocations_wrap(const module_data_t *mod){
+	const char *mod_name = dr_module_preferred_name(mod);
+	// The dynamic loader has its own minimal malloc, used before libc is there
+	if(mod_name != NULL && strstr(mod_name, "ld-linux") == mod_name)
+		return;
+	for(auto &allocator : allocators){
+		app_pc pc = (app_pc)dr_get_proc_address(mod->handle, allocator.name);
+		if(pc == NULL)
+			continue;
+		if(!drwrap_wrap(pc, allocator.pre, allocator.post))
+			dr_printf("> WARNING: Couldn't wrap %s in %s\n", allocator.name, mod_name == NULL ? "<unknown>" : mod_name);
+	}
+}
+
+
+AllocationLookup::AllocationLookup(){
+	cached_start = 0;
+	cached_end = 0;
+	cached_site = NO_ALLOCATION_SITE;
+	cached_generation = 0;
+}
+
+
+int AllocationLookup::site_of(app_pc addr){
+	ptr_uint_t address = (ptr_uint_t)addr;
+	unsigned long long current = generation.load(std::memory_order_relaxed);
+	if(address >= cached_start && address < cached_end && cached_generation == current)
+		return cached_site;
+
+	int site = NO_ALLOCATION_SITE;
+	dr_mutex_lock(allocations_lock);
+	auto it = live_blocks.upper_bound(address);
+	if(it != live_blocks.begin()){
+		--it;
+		if(address < it->second.end){
+			site = it->second.site;
+			cached_start = it->first;
+			cached_end = it->second.end;
+			cached_site = site;
+			cached_generation = current;
+		}
+	}
+	dr_mutex_unlock(allocations_lock);
+	return site;
+}
+
+
+void AllocationTraffic::add(int site, unsigned long long bytes, bool write){
+	allocation_traffic_t &traffic = sites[site];
+	if(write)
+		traffic.write_bytes += bytes;
+	else
+		traffic.read_bytes += bytes;
+}
+
+
+void AllocationTraffic::merge(const AllocationTraffic &other){
+	for(auto &site : other.sites){
+		allocation_traffic_t &traffic = sites[site.first];
+		traffic.read_bytes += site.second.read_bytes;
+		traffic.write_bytes += site.second.write_bytes;
+	}
+}
+
+
+void AllocationTraffic::scale(double factor){
+	for(auto &site : sites){
+		site.second.read_bytes = (unsigned long long)(site.second.read_bytes * factor + 0.5);
+		site.second.write_bytes = (unsigned long long)(site.second.write_bytes * factor + 0.5);
+	}
+}
+
+
+void AllocationTraffic::clear(void){
+	sites.clear();
+}
+
+
+void AllocationTraffic::dump(file_t out_file){
+	dr_fprintf(out_file, "<allocations>\n");
+	for(auto &site : sites){
+		if(site.first == NO_ALLOCATION_SITE){
+			dr_fprintf(out_file, "<unattributed read_bytes=\"%llu\" write_bytes=\"%llu\"/>\n",
+					site.second.read_bytes, site.second.write_bytes);
+			continue;
+		}
+		dr_mutex_lock(allocations_lock);
+		allocation_site_t info = allocation_sites[site.first];
+		dr_mutex_unlock(allocations_lock);
+		std::string function, src;
+		lookup_pc_symbol(info.caller, &function, &src);
+		dr_fprintf(out_file, "<site caller=\"" PFX "\" function=\"%s\" src=\"%s\" allocations=\"%llu\" max_size=\"%llu\" "
+				"read_bytes=\"%llu\" write_bytes=\"%llu\"/>\n",
+				info.caller, xml_escape(function).c_str(), xml_escape(src).c_str(), info.allocations, info.max_size,
+				site.second.read_bytes, site.second.write_bytes);
+	}
+	dr_fprintf(out_file, "</allocations>\n");
+}
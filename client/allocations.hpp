@@ -0,0 +1,62 @@
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+
+
+#include "dr_api.h"
+#include <map>
+
+/* Memory traffic per allocation site (--allocations).
+ * malloc, calloc, realloc, posix_memalign, aligned_alloc, free and the global operators new and delete,
+ * aligned ones included, are wrapped with drwrap in every module exporting them. Only the outermost call of a thread is
+ * tracked, so that operator new calling malloc is a single allocation.
+ * Live blocks go into an interval index shared by all the threads, keyed by their start address.
+ * An allocation site is the instruction calling the allocator (its return address).
+ * Within the ROIs, the bytes read and written are then attributed to the site of the block
+ * holding the accessed address. Each thread remembers the last block it hit, as long as no block
+ * has been freed in the meantime, so that streaming through an array seldom looks the index up.
+ * */
+
+#define NO_ALLOCATION_SITE -1
+
+void allocations_init(void);
+void allocations_exit(void);
+// Wraps the allocator functions the module exports
+void allocations_wrap(const module_data_t *mod);
+
+
+typedef struct _allocation_traffic_t {
+	unsigned long long read_bytes;
+	unsigned long long write_bytes;
+} allocation_traffic_t;
+
+// Traffic of a ROI, per allocation site (NO_ALLOCATION_SITE: stack, globals, ...)
+class AllocationTraffic{
+public:
+  std::map<int, allocation_traffic_t> sites;
+
+  void add(int site, unsigned long long bytes, bool write);
+  void merge(const AllocationTraffic &other);
+  void scale(double factor);
+  void clear(void);
+  // Writes the <allocations> table, naming the sites
+  void dump(file_t out_file);
+};
+
+
+// The per-thread view of the interval index
+class AllocationLookup{
+public:
+  AllocationLookup();
+  // Site of the live block holding addr, NO_ALLOCATION_SITE if none
+  int site_of(app_pc addr);
+
+private:
+  // The block hit last, valid while no block has been freed since
+  ptr_uint_t cached_start;
+  ptr_uint_t cached_end;
+  int cached_site;
+  unsigned long long cached_generation;
+};
+
+
+#endif
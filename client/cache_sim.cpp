@@ -0,0 +1,281 @@
+#include "cache_sim.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#define SYSFS_CACHE_DIR "/sys/devices/system/cpu/cpu0/cache"
+#define MAX_SYSFS_INDEX 16
+
+// Simulated when neither sysfs nor --cache_config tell anything
+#define DEFAULT_CACHE_CONFIG "32K:8:64,1M:16:64,32M:16:64"
+
+// Geometry shared by the hierarchies of all the threads, set up once by cache_sim_init
+static std::vector<cache_level_config_t> hierarchy;
+
+
+// "32K", "1M", "1048576", ... in bytes, 0 if malformed
+static unsigned long long parse_size(const char *str, char **end){
+	unsigned long long size = strtoull(str, end, 10);
+	switch(**end){
+	case 'K': case 'k': size <<= 10; (*end)++; break;
+	case 'M': case 'm': size <<= 20; (*end)++; break;
+	case 'G': case 'g': size <<= 30; (*end)++; break;
+	default: break;
+	}
+	return size;
+}
+
+
+static bool parse_config(std::string config){
+	hierarchy.clear();
+	const char *str = config.c_str();
+	while(*str != '\0'){
+		cache_level_config_t level;
+		char *end;
+		level.size = parse_size(str, &end);
+		if(*end != ':')
+			return false;
+		level.ways = (unsigned int)strtoul(end + 1, &end, 10);
+		if(*end != ':')
+			return false;
+		level.line_size = (unsigned int)strtoul(end + 1, &end, 10);
+		if(*end != ',' && *end != '\0')
+			return false;
+		hierarchy.push_back(level);
+		str = *end == ',' ? end + 1 : end;
+	}
+	return !hierarchy.empty();
+}
+
+
+// Reads a whole sysfs attribute, without the trailing newline
+static bool read_sysfs(int index, const char *attribute, char *buf, size_t size){
+	char path[MAXIMUM_PATH];
+	dr_snprintf(path, sizeof(path), SYSFS_CACHE_DIR "/index%d/%s", index, attribute);
+	file_t f = dr_open_file(path, DR_FILE_READ);
+	if(f == INVALID_FILE)
+		return false;
+	ssize_t read = dr_read_file(f, buf, size - 1);
+	dr_close_file(f);
+	if(read <= 0)
+		return false;
+	buf[read] = '\0';
+	if(buf[read - 1] == '\n')
+		buf[read - 1] = '\0';
+	return true;
+}
+
+
+// The data and unified caches of the first cpu, sorted by level
+static bool read_sysfs_config(void){
+	std::vector<std::pair<int, cache_level_config_t>> found;
+	char buf[64];
+	char *end;
+	for(int index = 0; index < MAX_SYSFS_INDEX; index++){
+		if(!read_sysfs(index, "type", buf, sizeof(buf)))
+			break;
+		if(strcmp(buf, "Instruction") == 0)
+			continue;
+		cache_level_config_t level;
+		if(!read_sysfs(index, "level", buf, sizeof(buf)))
+			return false;
+		int level_n = atoi(buf);
+		if(!read_sysfs(index, "size", buf, sizeof(buf)))
+			return false;
+		level.size = parse_size(buf, &end);
+		if(!read_sysfs(index, "coherency_line_size", buf, sizeof(buf)))
+			return false;
+		level.line_size = (unsigned int)atoi(buf);
+		// Fully associative caches may report 0 ways
+		level.ways = read_sysfs(index, "ways_of_associativity", buf, sizeof(buf)) ? (unsigned int)atoi(buf) : 0;
+		if(level.ways == 0 && level.line_size > 0)
+			level.ways = (unsigned int)(level.size / level.line_size);
+		found.push_back(std::make_pair(level_n, level));
+	}
+	std::sort(found.begin(), found.end(),
+			[](const std::pair<int, cache_level_config_t> &a, const std::pair<int, cache_level_config_t> &b){
+				return a.first < b.first; });
+	hierarchy.clear();
+	for(auto &level : found)
+		hierarchy.push_back(level.second);
+	return !hierarchy.empty();
+}
+
+
+void cache_sim_init(std::string config){
+	if(!config.empty())
+		DR_ASSERT_MSG(parse_config(config), "> ERROR: --cache_config must be a list of <size>:<ways>:<line size>, e.g. 32K:8:64,1M:16:64\n");
+	else if(!read_sysfs_config()){
+		dr_printf("> Roofline: Couldn't read the cache hierarchy from " SYSFS_CACHE_DIR ", simulating " DEFAULT_CACHE_CONFIG "\n");
+		parse_config(DEFAULT_CACHE_CONFIG);
+	}
+	DR_ASSERT_MSG(hierarchy.size() <= CACHE_MAX_LEVELS, "> ERROR: Too many cache levels to simulate\n");
+	for(unsigned int i = 0; i < hierarchy.size(); i++){
+		cache_level_config_t &level = hierarchy[i];
+		DR_ASSERT_MSG(level.line_size > 0 && (level.line_size & (level.line_size - 1)) == 0,
+				"> ERROR: The cache line size must be a power of two\n");
+		DR_ASSERT_MSG(level.line_size == hierarchy[0].line_size, "> ERROR: All the simulated cache levels must share the same line size\n");
+		DR_ASSERT_MSG(level.ways > 0 && level.size >= (unsigned long long)level.ways * level.line_size,
+				"> ERROR: Each cache level must hold at least a line per way\n");
+		dr_printf("> Roofline: Simulating L%u: %llu bytes, %u ways, %u bytes lines\n", i + 1, level.size, level.ways, level.line_size);
+	}
+}
+
+
+unsigned int cache_sim_levels(void){
+	return hierarchy.size();
+}
+
+
+bool is_non_temporal_store(instr_t *instr){
+	if(!instr_writes_memory(instr))
+		return false;
+	switch(instr_get_opcode(instr)){
+#ifdef FLOATING_POINTS_X86
+	case OP_movntps:
+	case OP_movntpd:
+	case OP_movntdq:
+	case OP_movnti:
+	case OP_movntq:
+	case OP_movntss:
+	case OP_movntsd:
+	case OP_vmovntps:
+	case OP_vmovntpd:
+	case OP_vmovntdq:
+	case OP_maskmovq:
+	case OP_maskmovdqu:
+	case OP_vmaskmovdqu:
+#elif defined(AARCH64)
+	case OP_stnp:
+#endif
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+CacheHierarchy::CacheHierarchy(){
+	clock = 0;
+	line_shift = 0;
+	for(unsigned int i = 0; i <= CACHE_MAX_LEVELS; i++)
+		traffic[i] = 0;
+	if(hierarchy.empty())
+		return;
+	while((1U << line_shift) < hierarchy[0].line_size)
+		line_shift++;
+	for(auto &config : hierarchy){
+		cache_level_t level;
+		level.ways = config.ways;
+		level.sets = (unsigned int)(config.size / config.line_size / config.ways);
+		level.lines.assign((size_t)level.sets * level.ways, 0);
+		level.last_use.assign((size_t)level.sets * level.ways, 0);
+		level.dirty.assign((size_t)level.sets * level.ways, false);
+		levels.push_back(std::move(level));
+	}
+}
+
+
+int CacheHierarchy::lookup(cache_level_t &level, ptr_uint_t line){
+	size_t base = (size_t)(line % level.sets) * level.ways;
+	for(unsigned int way = 0; way < level.ways; way++){
+		if(level.lines[base + way] == line + 1)
+			return (int)(base + way);
+	}
+	return -1;
+}
+
+
+// Fills the given level with line, writing back its dirty victim to the level below
+void CacheHierarchy::fill(unsigned int level_n, ptr_uint_t line, bool dirty){
+	cache_level_t &level = levels[level_n];
+	size_t base = (size_t)(line % level.sets) * level.ways;
+	size_t victim = base;
+	for(size_t slot = base; slot < base + level.ways; slot++){
+		if(level.lines[slot] == 0){
+			victim = slot;
+			break;
+		}
+		if(level.last_use[slot] < level.last_use[victim])
+			victim = slot;
+	}
+	if(level.lines[victim] != 0 && level.dirty[victim]){
+		ptr_uint_t victim_line = level.lines[victim] - 1;
+		traffic[level_n + 1] += 1ULL << line_shift;
+		if(level_n + 1 < levels.size()){
+			int below = lookup(levels[level_n + 1], victim_line);
+			if(below >= 0){
+				levels[level_n + 1].dirty[below] = true;
+				levels[level_n + 1].last_use[below] = ++clock;
+			}
+			else
+				fill(level_n + 1, victim_line, true);
+		}
+	}
+	level.lines[victim] = line + 1;
+	level.last_use[victim] = ++clock;
+	level.dirty[victim] = dirty;
+}
+
+
+void CacheHierarchy::access_line(ptr_uint_t line, bool write){
+	unsigned int hit = levels.size();
+	for(unsigned int i = 0; i < levels.size(); i++){
+		int slot = lookup(levels[i], line);
+		if(slot >= 0){
+			levels[i].last_use[slot] = ++clock;
+			if(i == 0 && write)
+				levels[i].dirty[slot] = true;
+			hit = i;
+			break;
+		}
+	}
+	// The line travels from where it was found up to L1 (write-allocate: stores fetch it as well)
+	for(unsigned int i = 1; i <= hit; i++)
+		traffic[i] += 1ULL << line_shift;
+	for(unsigned int i = hit; i > 0; i--)
+		fill(i - 1, line, i == 1 && write);
+}
+
+
+// Non-temporal stores go straight to memory, evicting the line from every level
+void CacheHierarchy::bypass_line(ptr_uint_t line, unsigned int bytes){
+	for(auto &level : levels){
+		int slot = lookup(level, line);
+		if(slot < 0)
+			continue;
+		if(level.dirty[slot])
+			traffic[levels.size()] += 1ULL << line_shift;
+		level.lines[slot] = 0;
+		level.dirty[slot] = false;
+	}
+	traffic[levels.size()] += bytes;
+}
+
+
+void CacheHierarchy::access(app_pc addr, unsigned int size, bool write, bool non_temporal){
+	if(size == 0 || levels.empty())
+		return;
+	traffic[0] += size;
+	ptr_uint_t first = (ptr_uint_t)addr >> line_shift;
+	ptr_uint_t last = ((ptr_uint_t)addr + size - 1) >> line_shift;
+	for(ptr_uint_t line = first; line <= last; line++){
+		if(non_temporal){
+			ptr_uint_t start = std::max((ptr_uint_t)addr, line << line_shift);
+			ptr_uint_t end = std::min((ptr_uint_t)addr + size, (line + 1) << line_shift);
+			bypass_line(line, (unsigned int)(end - start));
+		}
+		else
+			access_line(line, write);
+	}
+}
+
+
+void CacheHierarchy::drain_traffic(cache_traffic_t &to){
+	unsigned int n = levels.size();
+	for(unsigned int i = 0; i < n; i++)
+		to.level_bytes[i] += traffic[i];
+	to.dram_bytes += traffic[n];
+	for(unsigned int i = 0; i <= CACHE_MAX_LEVELS; i++)
+		traffic[i] = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef CACHE_SIM_H
+#define CACHE_SIM_H
+
+
+#include "dr_api.h"
+#include "point.hpp"
+#include <string>
+#include <vector>
+
+/* Cache-aware roofline (--cache_sim).
+ * The accessed addresses, taken from the address-carrying memory reference entries,
+ * are fed to a per-thread model of the data cache hierarchy: set-associative levels
+ * with LRU replacement, write-back and write-allocate. Every level holds the lines
+ * it has been filled with, whatever the other levels hold (neither inclusive nor exclusive).
+ * Non-temporal stores bypass the caches: they invalidate the line and go to memory.
+ * The geometry of the levels is read from /sys/devices/system/cpu/cpu0/cache, unless
+ * given through --cache_config. The traffic between each pair of adjacent levels is
+ * added to the current point (see cache_traffic_t).
+ * Each thread simulates the whole hierarchy on its own, shared levels included, with
+ * about 16 bytes of state per line: a 32 MiB last level cache takes about 8 MiB per thread.
+ * */
+
+typedef struct _cache_level_config_t {
+	unsigned long long size; // In bytes
+	unsigned int ways;
+	unsigned int line_size;
+} cache_level_config_t;
+
+// Sets up the hierarchy simulated by each thread: config is the --cache_config
+// value, "<size>:<ways>:<line size>" per level from L1 on, e.g. "32K:8:64,1M:16:64".
+// When empty, the hierarchy of the machine is read from sysfs.
+void cache_sim_init(std::string config);
+// Number of simulated levels, once set up
+unsigned int cache_sim_levels(void);
+
+// Whether the given store bypasses the caches
+bool is_non_temporal_store(instr_t *instr);
+
+
+class CacheHierarchy{
+public:
+  CacheHierarchy();
+  // An access of size bytes at addr: write tells whether it dirties the line
+  void access(app_pc addr, unsigned int size, bool write, bool non_temporal);
+  // Adds the traffic gathered so far to the given counters and resets it
+  void drain_traffic(cache_traffic_t &to);
+
+private:
+  typedef struct _cache_level_t {
+    unsigned int sets;
+    unsigned int ways;
+    // Per way of each set: line address + 1 (0 when invalid), last use and dirty bit
+    std::vector<ptr_uint_t> lines;
+    std::vector<unsigned long long> last_use;
+    std::vector<bool> dirty;
+  } cache_level_t;
+
+  std::vector<cache_level_t> levels;
+  unsigned int line_shift;
+  unsigned long long clock;
+  // traffic[i]: bytes moved between level i - 1 and level i, traffic[0] being
+  // the bytes the core accesses and traffic[levels.size()] the memory ones.
+  unsigned long long traffic[CACHE_MAX_LEVELS + 1];
+
+  // Index of the way of level holding line, -1 if missing
+  int lookup(cache_level_t &level, ptr_uint_t line);
+  void fill(unsigned int level, ptr_uint_t line, bool dirty);
+  void access_line(ptr_uint_t line, bool write);
+  void bypass_line(ptr_uint_t line, unsigned int bytes);
+};
+
+
+#endif
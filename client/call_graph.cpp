@@ -0,0 +1,145 @@
+#include "call_graph.hpp"
+#include "symbols.hpp"
+
+// Function table, shared by all the threads: filled at block build time
+static std::unordered_map<std::string, int> function_ids;
+static std::vector<std::string> function_names;
+static void *function_table_lock;
+
+
+void call_graph_init(void){
+	function_table_lock = dr_mutex_create();
+}
+
+
+void call_graph_exit(void){
+	dr_mutex_destroy(function_table_lock);
+}
+
+
+static int get_function_id(const std::string &name){
+	dr_mutex_lock(function_table_lock);
+	int func_id;
+	auto it = function_ids.find(name);
+	if(it != function_ids.end())
+		func_id = it->second;
+	else{
+		func_id = function_names.size();
+		function_ids[name] = func_id;
+		function_names.push_back(name);
+	}
+	dr_mutex_unlock(function_table_lock);
+	return func_id;
+}
+
+
+int call_graph_function_id(app_pc tag, bool *is_entry){
+	*is_entry = false;
+	pc_symbol_t symbol;
+	if(lookup_pc_symbol(tag, &symbol)){
+		*is_entry = symbol.is_entry;
+		return get_function_id(symbol.function);
+	}
+	// No symbol: the whole module is taken as a single function
+	return get_function_id(symbol.module.empty() ? "<unknown>" : "<" + symbol.module + ">");
+}
+
+
+std::string call_graph_function_name(int func_id){
+	dr_mutex_lock(function_table_lock);
+	std::string name = function_names[func_id];
+	dr_mutex_unlock(function_table_lock);
+	return name;
+}
+
+
+void ShadowCallStack::push(int func_id, reg_t sp, app_pc return_address){
+	int &count = occurrences[func_id];
+	frames.push_back(frame_t{func_id, count == 0, path.size(), sp, return_address});
+	count++;
+	if(!path.empty())
+		path += ";";
+	path += std::to_string(func_id);
+}
+
+
+void ShadowCallStack::pop(void){
+	frame_t &top = frames.back();
+	occurrences[top.func_id]--;
+	path.resize(top.path_length);
+	frames.pop_back();
+}
+
+
+void ShadowCallStack::enter_block(void *drcontext, int func_id, bool is_entry, app_pc tag){
+	dr_mcontext_t mc;
+	mc.size = sizeof(mc);
+	mc.flags = IF_X86_ELSE(DR_MC_CONTROL, DR_MC_CONTROL | DR_MC_INTEGER);
+	dr_get_mcontext(drcontext, &mc);
+	reg_t sp = mc.xsp;
+
+	// Frames whose invocation is over: returned, or unwound past
+	while(!frames.empty() && (sp > frames.back().sp || (tag == frames.back().return_address && sp == frames.back().sp)))
+		pop();
+
+	if(is_entry){
+		// Branching back to the entry of the function on top (a loop headed by the entry block): no call
+		if(!frames.empty() && frames.back().func_id == func_id && frames.back().sp == sp)
+			return;
+		push(func_id, sp, IF_X86_ELSE(NULL, (app_pc)mc.lr));
+		return;
+	}
+	if(!frames.empty() && frames.back().func_id == func_id)
+		return;
+	// Returning (or jumping) to a function further down the stack
+	if(occurrences[func_id] > 0){
+		while(frames.back().func_id != func_id)
+			pop();
+		return;
+	}
+	// Never seen entering it (e.g. the stack was out of sync when the ROI began): its frame goes with the current stack pointer
+	push(func_id, sp, NULL);
+}
+
+
+void ShadowCallStack::attribute(const call_graph_counters_t &counters){
+	if(frames.empty())
+		return;
+	exclusive[frames.back().func_id].add(counters);
+	for(auto &frame : frames){
+		if(frame.first_occurrence)
+			inclusive[frame.func_id].add(counters);
+	}
+	paths[path].add(counters);
+}
+
+
+void ShadowCallStack::save(Point &point){
+	for(auto &entry : inclusive)
+		point.functions_inclusive[call_graph_function_name(entry.first)].add(entry.second);
+	for(auto &entry : exclusive)
+		point.functions_exclusive[call_graph_function_name(entry.first)].add(entry.second);
+	for(auto &entry : paths){
+		// Translate the ids into names
+		std::string names;
+		size_t start = 0;
+		while(start < entry.first.size()){
+			size_t end = entry.first.find(';', start);
+			if(end == std::string::npos)
+				end = entry.first.size();
+			if(!names.empty())
+				names += ";";
+			names += call_graph_function_name(std::stoi(entry.first.substr(start, end - start)));
+			start = end + 1;
+		}
+		point.call_paths[names].add(entry.second);
+	}
+	clear_counters();
+}
+
+
+void ShadowCallStack::clear_counters(void){
+	inclusive.clear();
+	exclusive.clear();
+	paths.clear();
+}
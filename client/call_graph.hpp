@@ -0,0 +1,70 @@
+#ifndef CALL_GRAPH_H
+#define CALL_GRAPH_H
+
+
+#include "dr_api.h"
+#include "point.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Call graph attribution (--call_graph).
+ * Each basic block is attributed to its enclosing function, resolved with drsyms
+ * from the block tag when the block is built. Functions are then identified by an id.
+ * At runtime, every executed block keeps a per-thread shadow call stack in sync, each
+ * frame recording the stack pointer at its entry (and, on AArch64, the return address):
+ * - frames the stack pointer has gone past are over: returns, longjmps and exceptions
+ *   don't need to be instrumented. On AArch64 the stack pointer is back to its value at
+ *   the entry once returned: reaching the return address with it tells the return apart;
+ * - a block starting at its function entry point pushes a new frame, unless it is the
+ *   function on top of the stack branching back to its entry (same stack pointer);
+ * - any other block pops frames until its function is found on the stack.
+ * Recursion thus gets a frame per invocation, popped when the invocation returns.
+ * Flops and bytes are then attributed to the function on top of the stack (exclusive),
+ * to every function on the stack (inclusive), and to the current call path.
+ * */
+
+void call_graph_init(void);
+void call_graph_exit(void);
+
+// Build time: id of the function the block starting at tag belongs to.
+// is_entry tells whether the block starts at the function entry point.
+int call_graph_function_id(app_pc tag, bool *is_entry);
+std::string call_graph_function_name(int func_id);
+
+
+class ShadowCallStack{
+public:
+  // An executed block of the given function, starting at tag. The stack pointer comes from the current mcontext.
+  void enter_block(void *drcontext, int func_id, bool is_entry, app_pc tag);
+  // Attributes the given counters to the current stack
+  void attribute(const call_graph_counters_t &counters);
+  // Moves what has been attributed so far into the given point, resolving the function names
+  void save(Point &point);
+  // Drops what has been attributed so far: the stack itself is kept
+  void clear_counters(void);
+
+private:
+  typedef struct _frame_t {
+    int func_id;
+    bool first_occurrence; // Recursion: the function is not already on the stack below
+    size_t path_length;    // Length of the call path up to the previous frame
+    reg_t sp;              // Stack pointer when the frame was pushed
+    app_pc return_address; // AArch64: link register at the function entry, NULL otherwise
+  } frame_t;
+
+  std::vector<frame_t> frames;
+  // Ids of the functions on the stack, ';' separated
+  std::string path;
+  std::unordered_map<int, int> occurrences;
+
+  std::unordered_map<int, call_graph_counters_t> inclusive;
+  std::unordered_map<int, call_graph_counters_t> exclusive;
+  std::unordered_map<std::string, call_graph_counters_t> paths;
+
+  void push(int func_id, reg_t sp, app_pc return_address);
+  void pop(void);
+};
+
+
+#endif
@@ -0,0 +1,244 @@
+#include "false_sharing.hpp"
+#include "symbols.hpp"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define NUM_STRIPES 256
+// Distinct pcs kept per line: enough to name the culprits
+#define MAX_LINE_PCS 8
+#define MAX_REPORTED_LINES 32
+// Lines touched by a single thread kept per stripe, about 64 bytes each: 4M lines, 256 MiB of footprint, in total
+#define MAX_PRIVATE_LINES ((1 << 22) / NUM_STRIPES)
+
+// What a thread did to a line
+typedef struct _thread_access_t {
+	unsigned int tid;
+	uint64 written;            // Bitmask of the bytes written
+	uint64 read;               // Bitmask of the bytes read
+	unsigned long long seen;   // Writes to the line the thread has already observed
+} thread_access_t;
+
+typedef struct _line_pc_t {
+	app_pc pc;
+	unsigned int tid;
+	bool write;
+} line_pc_t;
+
+typedef struct _shared_line_t {
+	std::vector<thread_access_t> threads;
+	std::vector<line_pc_t> pcs;
+	unsigned long long writes;
+	unsigned long long transfers;
+	unsigned int last_writer;
+} shared_line_t;
+
+// A line only one thread has touched so far: no transfers yet, and a single pc to name
+typedef struct _private_line_t {
+	unsigned int tid;
+	bool pc_write;
+	app_pc pc;
+	uint64 written;
+	uint64 read;
+	unsigned long long writes;
+} private_line_t;
+
+typedef struct _stripe_t {
+	void *lock;
+	std::unordered_map<ptr_uint_t, private_line_t> private_lines;
+	std::unordered_map<ptr_uint_t, shared_line_t> lines;
+	// Accesses to lines left out because private_lines was full
+	unsigned long long untracked;
+} stripe_t;
+
+static stripe_t stripes[NUM_STRIPES];
+
+
+void false_sharing_init(void){
+	for(int i = 0; i < NUM_STRIPES; i++)
+		stripes[i].lock = dr_mutex_create();
+}
+
+
+void false_sharing_exit(void){
+	for(int i = 0; i < NUM_STRIPES; i++){
+		dr_mutex_destroy(stripes[i].lock);
+		stripes[i].private_lines.clear();
+		stripes[i].lines.clear();
+	}
+}
+
+
+// Neighbouring lines have to go to different stripes
+static unsigned int get_stripe(ptr_uint_t line){
+	return (unsigned int)(((uint64)line * 0x9e3779b97f4a7c15ULL) >> 56) % NUM_STRIPES;
+}
+
+
+// stripe lock held
+static void access_line(shared_line_t &line, unsigned int tid, uint64 mask, bool write, app_pc pc){
+	thread_access_t *access = NULL;
+	for(auto &thread : line.threads){
+		if(thread.tid == tid){
+			access = &thread;
+			break;
+		}
+	}
+	if(access == NULL){
+		line.threads.push_back(thread_access_t{tid, 0, 0, 0});
+		access = &line.threads.back();
+	}
+	// Another thread wrote the line since this one last accessed it: it has to be fetched again
+	if(line.writes > access->seen && line.last_writer != tid)
+		line.transfers++;
+	if(write){
+		access->written |= mask;
+		line.writes++;
+		line.last_writer = tid;
+	}
+	else
+		access->read |= mask;
+	access->seen = line.writes;
+
+	if(line.pcs.size() < MAX_LINE_PCS){
+		for(auto &line_pc : line.pcs){
+			if(line_pc.pc == pc && line_pc.tid == tid && line_pc.write == write)
+				return;
+		}
+		line.pcs.push_back(line_pc_t{pc, tid, write});
+	}
+}
+
+
+// stripe lock held. Returns the full record of line once a second thread touches it, NULL until then.
+static shared_line_t *track_line(stripe_t &stripe, ptr_uint_t line, unsigned int tid, uint64 mask, bool write, app_pc pc){
+	auto it = stripe.lines.find(line);
+	if(it != stripe.lines.end())
+		return &it->second;
+	auto private_it = stripe.private_lines.find(line);
+	if(private_it == stripe.private_lines.end()){
+		if(stripe.private_lines.size() >= MAX_PRIVATE_LINES){
+			stripe.untracked++;
+			return NULL;
+		}
+		stripe.private_lines.emplace(line, private_line_t{tid, write, pc, write ? mask : 0, write ? 0 : mask, write ? 1ULL : 0});
+		return NULL;
+	}
+	private_line_t &owner = private_it->second;
+	if(owner.tid == tid){
+		if(write){
+			owner.written |= mask;
+			owner.writes++;
+		}
+		else
+			owner.read |= mask;
+		return NULL;
+	}
+	// A second thread: from now on the line is followed in full, starting from what its owner did
+	shared_line_t shared{{thread_access_t{owner.tid, owner.written, owner.read, owner.writes}},
+			{line_pc_t{owner.pc, owner.tid, owner.pc_write}}, owner.writes, 0, owner.tid};
+	stripe.private_lines.erase(private_it);
+	return &stripe.lines.emplace(line, shared).first->second;
+}
+
+
+void false_sharing_access(unsigned int tid, app_pc addr, unsigned int size, bool write, app_pc pc){
+	if(size == 0)
+		return;
+	ptr_uint_t first = (ptr_uint_t)addr;
+	ptr_uint_t last = first + size - 1;
+	for(ptr_uint_t line = first >> FALSE_SHARING_LINE_SHIFT; line <= last >> FALSE_SHARING_LINE_SHIFT; line++){
+		ptr_uint_t line_start = line << FALSE_SHARING_LINE_SHIFT;
+		unsigned int from = (unsigned int)(std::max(first, line_start) - line_start);
+		unsigned int to = (unsigned int)(std::min(last, line_start + (1 << FALSE_SHARING_LINE_SHIFT) - 1) - line_start);
+		uint64 mask = (to - from == 63) ? ~0ULL : ((1ULL << (to - from + 1)) - 1) << from;
+		stripe_t &stripe = stripes[get_stripe(line)];
+		dr_mutex_lock(stripe.lock);
+		shared_line_t *shared = track_line(stripe, line, tid, mask, write, pc);
+		if(shared != NULL)
+			access_line(*shared, tid, mask, write, pc);
+		dr_mutex_unlock(stripe.lock);
+	}
+}
+
+
+// A thread writes bytes another one accesses, while neither of them touches bytes the other one writes
+static bool is_falsely_shared(const shared_line_t &line){
+	for(auto &writer : line.threads){
+		if(writer.written == 0)
+			continue;
+		uint64 writer_bytes = writer.written | writer.read;
+		for(auto &other : line.threads){
+			uint64 other_bytes = other.written | other.read;
+			if(other.tid != writer.tid && other_bytes != 0 && (writer.written & other_bytes) == 0 &&
+					(other.written & writer_bytes) == 0)
+				return true;
+		}
+	}
+	return false;
+}
+
+
+// "0-7,16-23": the bytes set in mask
+static std::string byte_ranges(uint64 mask){
+	std::string ranges;
+	for(int byte = 0; byte < 64; byte++){
+		if((mask & (1ULL << byte)) == 0)
+			continue;
+		int end = byte;
+		while(end + 1 < 64 && (mask & (1ULL << (end + 1))) != 0)
+			end++;
+		if(!ranges.empty())
+			ranges += ",";
+		ranges += std::to_string(byte) + "-" + std::to_string(end);
+		byte = end;
+	}
+	return ranges;
+}
+
+
+// Function and source line of pc
+static void write_pc(file_t out_file, const line_pc_t &line_pc){
+	std::string function, src;
+	lookup_pc_symbol(line_pc.pc, &function, &src);
+	dr_fprintf(out_file, "<pc address=\"" PFX "\" thread=\"%u\" access=\"%s\" function=\"%s\" src=\"%s\"/>\n",
+			line_pc.pc, line_pc.tid, line_pc.write ? "write" : "read",
+			xml_escape(function).c_str(), xml_escape(src).c_str());
+}
+
+
+void false_sharing_dump(file_t out_file, bool timing){
+	if(timing)
+		return;
+	std::vector<std::pair<ptr_uint_t, const shared_line_t*>> shared;
+	unsigned long long untracked = 0;
+	for(int i = 0; i < NUM_STRIPES; i++){
+		untracked += stripes[i].untracked;
+		for(auto &line : stripes[i].lines){
+			if(line.second.threads.size() > 1 && is_falsely_shared(line.second))
+				shared.push_back(std::make_pair(line.first, &line.second));
+		}
+	}
+	std::sort(shared.begin(), shared.end(),
+			[](const std::pair<ptr_uint_t, const shared_line_t*> &a, const std::pair<ptr_uint_t, const shared_line_t*> &b){
+				return a.second->transfers > b.second->transfers; });
+
+	if(untracked > 0)
+		dr_printf("> WARNING: The false sharing table is full, %llu accesses to lines touched afterwards have been left out\n", untracked);
+
+	dr_fprintf(out_file, "<false_sharing line_size=\"%u\" lines=\"%lu\" untracked_accesses=\"%llu\">\n",
+			1U << FALSE_SHARING_LINE_SHIFT, (unsigned long)shared.size(), untracked);
+	for(size_t i = 0; i < shared.size() && i < MAX_REPORTED_LINES; i++){
+		const shared_line_t &line = *shared[i].second;
+		dr_fprintf(out_file, "<line address=\"" PFX "\" transfers=\"%llu\" writes=\"%llu\">\n",
+				(app_pc)(shared[i].first << FALSE_SHARING_LINE_SHIFT), line.transfers, line.writes);
+		for(auto &thread : line.threads)
+			dr_fprintf(out_file, "<thread id=\"%u\" written=\"%s\" read=\"%s\"/>\n",
+					thread.tid, byte_ranges(thread.written).c_str(), byte_ranges(thread.read).c_str());
+		for(auto &line_pc : line.pcs)
+			write_pc(out_file, line_pc);
+		dr_fprintf(out_file, "</line>\n");
+	}
+	dr_fprintf(out_file, "</false_sharing>\n");
+}
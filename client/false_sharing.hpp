@@ -0,0 +1,33 @@
+#ifndef FALSE_SHARING_H
+#define FALSE_SHARING_H
+
+
+#include "dr_api.h"
+
+/* False sharing detection (--false_sharing).
+ * Within the ROIs, every access is recorded in a shadow table shared by all the threads, by 64 bytes
+ * cache line. A line touched by a single thread only keeps a small record: the bytes it wrote and read
+ * and its first pc. Once a second thread touches it, the table keeps which bytes each thread wrote and
+ * read, the pcs accessing it, and counts its transfers: accesses from a thread after another one wrote
+ * the line, which in a coherent cache move the line between cores. The single thread records are capped
+ * (MAX_PRIVATE_LINES), the accesses to lines past the cap are only counted. The table is split in stripes,
+ * each with its own lock and chosen by hashing the line address, so that threads accessing different
+ * lines hardly ever contend.
+ * A line is falsely shared when a thread writes bytes that another thread accesses, while neither of
+ * them touches bytes the other one writes. At exit, the lines falsely shared with the most transfers
+ * are reported.
+ * */
+
+#define FALSE_SHARING_LINE_SHIFT 6
+
+void false_sharing_init(void);
+void false_sharing_exit(void);
+
+// An access within a ROI, of size bytes at addr, by the instruction at pc of thread tid
+void false_sharing_access(unsigned int tid, app_pc addr, unsigned int size, bool write, app_pc pc);
+
+// Writes the <false_sharing> report. Nothing in timing documents.
+void false_sharing_dump(file_t out_file, bool timing);
+
+
+#endif
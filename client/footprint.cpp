@@ -0,0 +1,166 @@
+#include "footprint.hpp"
+#include <math.h>
+#include <algorithm>
+
+#define HLL_REGISTERS (1U << FOOTPRINT_HLL_PRECISION)
+// Four bytes per sparse register: past this, the full registers take less memory
+#define HLL_SPARSE_MAX (HLL_REGISTERS / 4)
+
+bool DistinctCounter::exact = false;
+
+
+// splitmix64 finalizer: consecutive lines and pages have to look random to the sketch
+static uint64 hash_key(uint64 key){
+	key += 0x9e3779b97f4a7c15ULL;
+	key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+	return key ^ (key >> 31);
+}
+
+
+DistinctCounter::DistinctCounter(){
+	last_key = 0;
+	empty = true;
+}
+
+
+void DistinctCounter::add(ptr_uint_t key){
+	if(!empty && key == last_key)
+		return;
+	last_key = key;
+	empty = false;
+	if(exact){
+		keys.insert(key);
+		return;
+	}
+	uint64 hash = hash_key(key);
+	// The first bits pick the register, it keeps the longest run of leading zeros of the others (plus one)
+	unsigned int index = (unsigned int)(hash >> (64 - FOOTPRINT_HLL_PRECISION));
+	uint64 rest = hash << FOOTPRINT_HLL_PRECISION;
+	unsigned char rank = 1;
+	while(rank <= 64 - FOOTPRINT_HLL_PRECISION && (rest & (1ULL << 63)) == 0){
+		rank++;
+		rest <<= 1;
+	}
+	update_register(index, rank);
+}
+
+
+void DistinctCounter::update_register(unsigned int index, unsigned char rank){
+	if(!registers.empty()){
+		if(rank > registers[index])
+			registers[index] = rank;
+		return;
+	}
+	auto it = std::lower_bound(sparse.begin(), sparse.end(), (uint32_t)index << 8);
+	if(it != sparse.end() && (*it >> 8) == index){
+		if(rank > (*it & 0xff))
+			*it = (uint32_t)index << 8 | rank;
+		return;
+	}
+	sparse.insert(it, (uint32_t)index << 8 | rank);
+	if(sparse.size() > HLL_SPARSE_MAX)
+		densify();
+}
+
+
+void DistinctCounter::densify(void){
+	registers.assign(HLL_REGISTERS, 0);
+	for(uint32_t entry : sparse)
+		registers[entry >> 8] = (unsigned char)(entry & 0xff);
+	std::vector<uint32_t>().swap(sparse);
+}
+
+
+void DistinctCounter::merge(const DistinctCounter &other){
+	if(other.empty)
+		return;
+	if(exact)
+		keys.insert(other.keys.begin(), other.keys.end());
+	else if(!other.registers.empty()){
+		if(registers.empty())
+			densify();
+		for(unsigned int i = 0; i < HLL_REGISTERS; i++){
+			if(other.registers[i] > registers[i])
+				registers[i] = other.registers[i];
+		}
+	}
+	else{
+		for(uint32_t entry : other.sparse)
+			update_register(entry >> 8, (unsigned char)(entry & 0xff));
+	}
+	// Both last keys are in the merged counter: skipping either of them is right
+	if(empty)
+		last_key = other.last_key;
+	empty = false;
+}
+
+
+unsigned long long DistinctCounter::count(void) const{
+	if(exact)
+		return keys.size();
+	if(registers.empty() && sparse.empty())
+		return 0;
+	double m = HLL_REGISTERS;
+	double sum = 0.0;
+	unsigned int zeros = 0;
+	if(!registers.empty()){
+		for(unsigned int i = 0; i < HLL_REGISTERS; i++){
+			sum += ldexp(1.0, -registers[i]);
+			if(registers[i] == 0)
+				zeros++;
+		}
+	}
+	else{
+		// The registers missing from the list are zero
+		zeros = HLL_REGISTERS - sparse.size();
+		sum = zeros;
+		for(uint32_t entry : sparse)
+			sum += ldexp(1.0, -(int)(entry & 0xff));
+	}
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double estimate = alpha * m * m / sum;
+	// Small cardinalities: linear counting on the empty registers is far more accurate
+	if(estimate <= 2.5 * m && zeros > 0)
+		estimate = m * log(m / zeros);
+	return (unsigned long long)(estimate + 0.5);
+}
+
+
+void DistinctCounter::clear(void){
+	sparse.clear();
+	registers.clear();
+	keys.clear();
+	last_key = 0;
+	empty = true;
+}
+
+
+void Footprint::add(app_pc addr, unsigned int size){
+	if(size == 0)
+		return;
+	ptr_uint_t first = (ptr_uint_t)addr;
+	ptr_uint_t last = first + size - 1;
+	for(ptr_uint_t line = first >> FOOTPRINT_LINE_SHIFT; line <= last >> FOOTPRINT_LINE_SHIFT; line++)
+		line_counter.add(line);
+	page_counter.add(first >> FOOTPRINT_PAGE_SHIFT);
+	if((last >> FOOTPRINT_PAGE_SHIFT) != (first >> FOOTPRINT_PAGE_SHIFT))
+		page_counter.add(last >> FOOTPRINT_PAGE_SHIFT);
+	huge_page_counter.add(first >> FOOTPRINT_HUGE_PAGE_SHIFT);
+	if((last >> FOOTPRINT_HUGE_PAGE_SHIFT) != (first >> FOOTPRINT_HUGE_PAGE_SHIFT))
+		huge_page_counter.add(last >> FOOTPRINT_HUGE_PAGE_SHIFT);
+}
+
+
+void Footprint::merge(const Footprint &other){
+	line_counter.merge(other.line_counter);
+	page_counter.merge(other.page_counter);
+	huge_page_counter.merge(other.huge_page_counter);
+}
+
+
+void Footprint::clear(void){
+	line_counter.clear();
+	page_counter.clear();
+	huge_page_counter.clear();
+}
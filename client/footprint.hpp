@@ -0,0 +1,72 @@
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+
+#include "dr_api.h"
+#include <stdint.h>
+#include <unordered_set>
+#include <vector>
+
+/* Memory footprint of a ROI (--footprint): the distinct 64 bytes cache lines,
+ * 4 KiB pages and 2 MiB pages it touches.
+ * By default each granularity is tracked by a HyperLogLog sketch, 2^FOOTPRINT_HLL_PRECISION
+ * one byte registers (about 0.8% standard error), whatever the size of the footprint.
+ * Small footprints only set a few registers: these are kept in a sorted list, four bytes each,
+ * until it grows as large as the registers themselves (16 KiB). ROIs touching little memory,
+ * e.g. the many calls of --calls_as_separate_roi, then take little memory as well.
+ * Sketches of different threads, or invocations, are merged by taking the maximum of each register.
+ * The exact mode (--footprint_exact) keeps the sets of touched lines and pages instead, for validation.
+ * */
+
+#define FOOTPRINT_HLL_PRECISION 14
+
+#define FOOTPRINT_LINE_SHIFT 6
+#define FOOTPRINT_PAGE_SHIFT 12
+#define FOOTPRINT_HUGE_PAGE_SHIFT 21
+
+class DistinctCounter{
+public:
+  DistinctCounter();
+  void add(ptr_uint_t key);
+  void merge(const DistinctCounter &other);
+  unsigned long long count(void) const;
+  void clear(void);
+
+  // Exact counting rather than estimation, the same for all the counters
+  static bool exact;
+
+private:
+  // HyperLogLog registers: the non-zero ones as (index << 8 | value), sorted, while they are few,
+  // then all of them
+  std::vector<uint32_t> sparse;
+  std::vector<unsigned char> registers;
+  std::unordered_set<ptr_uint_t> keys;
+  // The last key added, so that runs of accesses to the same line or page cost a comparison
+  ptr_uint_t last_key;
+  bool empty;
+
+  // Raises the given register to rank, if lower
+  void update_register(unsigned int index, unsigned char rank);
+  // Moves the sparse registers into the full ones
+  void densify(void);
+};
+
+
+class Footprint{
+public:
+  void add(app_pc addr, unsigned int size);
+  void merge(const Footprint &other);
+  void clear(void);
+
+  unsigned long long lines(void) const { return line_counter.count(); }
+  unsigned long long pages(void) const { return page_counter.count(); }
+  unsigned long long huge_pages(void) const { return huge_page_counter.count(); }
+
+private:
+  DistinctCounter line_counter;
+  DistinctCounter page_counter;
+  DistinctCounter huge_page_counter;
+};
+
+
+#endif
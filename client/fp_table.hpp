@@ -0,0 +1,415 @@
+#ifndef FP_TABLE_H
+#define FP_TABLE_H
+
+
+#include "dr_api.h"
+
+/* Floating point opcode table (see count_fp.hpp).
+ * Each FP opcode is listed once, with the operations it performs per lane and, for the x86 packed
+ * instructions, the width of its elements: the number of lanes is then the size of its widest
+ * operand (xmm, ymm or zmm) over the element width. Scalar instructions have a single lane.
+ * On AArch64 the element width is encoded in the instruction itself (see count_fp.hpp), SVE
+ * vectors being as wide as the vector length of the processor.
+ * The list is turned at compile time into a table indexed by opcode, checked for duplicates.
+ * Only arithmetic counts: logical operations, moves, blends and x87 stack manipulation are not flops.
+ * */
+
+typedef struct _fp_op_t {
+	unsigned char ops;        // Operations per lane, 0 if not a FP instruction
+	unsigned char elem_bytes; // Element width of the packed x86 instructions, 0 otherwise
+	bool across_lanes;        // A reduction: ops per pair of lanes, i.e. lanes - 1 times
+} fp_op_t;
+
+typedef struct _fp_opcode_t {
+	int opcode;
+	fp_op_t op;
+} fp_opcode_t;
+
+#define FP_OP(opcode, ops) {opcode, {ops, 0, false}}
+#define FP_ACROSS(opcode, ops) {opcode, {ops, 0, true}}
+#define FP_PACKED(opcode, ops, elem_bytes) {opcode, {ops, elem_bytes, false}}
+#define FP_PS(opcode, ops) FP_PACKED(opcode, ops, 4)
+#define FP_PD(opcode, ops) FP_PACKED(opcode, ops, 8)
+
+#ifdef FLOATING_POINTS_ARM
+/* Scalar, NEON 64 and 128 bits vector and by element forms share their opcode */
+static constexpr fp_opcode_t fp_opcodes[] = {
+	FP_OP(OP_fabd, 1),
+	FP_OP(OP_fabs, 1),
+	FP_OP(OP_facge, 1),
+	FP_OP(OP_facgt, 1),
+	FP_OP(OP_fadd, 1),
+	FP_OP(OP_faddp, 1),
+	FP_OP(OP_fcadd, 1),
+	FP_OP(OP_fccmp, 1),
+	FP_OP(OP_fccmpe, 1),
+	FP_OP(OP_fcmeq, 1),
+	FP_OP(OP_fcmge, 1),
+	FP_OP(OP_fcmgt, 1),
+	FP_OP(OP_fcmle, 1),
+	FP_OP(OP_fcmlt, 1),
+	FP_OP(OP_fcmp, 1),
+	FP_OP(OP_fcmpe, 1),
+	FP_OP(OP_fdiv, 1),
+	FP_OP(OP_fmax, 1),
+	FP_OP(OP_fmaxnm, 1),
+	FP_OP(OP_fmaxnmp, 1),
+	FP_OP(OP_fmaxp, 1),
+	FP_OP(OP_fmin, 1),
+	FP_OP(OP_fminnm, 1),
+	FP_OP(OP_fminnmp, 1),
+	FP_OP(OP_fminp, 1),
+	FP_OP(OP_fmul, 1),
+	FP_OP(OP_fmulx, 1),
+	FP_OP(OP_fneg, 1),
+	FP_OP(OP_frecpe, 1),
+	FP_OP(OP_frecps, 1),
+	FP_OP(OP_frecpx, 1),
+	FP_OP(OP_frsqrte, 1),
+	FP_OP(OP_frsqrts, 1),
+	FP_OP(OP_fsqrt, 1),
+	FP_OP(OP_fsub, 1),
+	// Conversions and rounding
+	FP_OP(OP_fcvt, 1),
+	FP_OP(OP_fcvtas, 1),
+	FP_OP(OP_fcvtau, 1),
+	FP_OP(OP_fcvtl, 1),
+	FP_OP(OP_fcvtl2, 1),
+	FP_OP(OP_fcvtms, 1),
+	FP_OP(OP_fcvtmu, 1),
+	FP_OP(OP_fcvtn, 1),
+	FP_OP(OP_fcvtn2, 1),
+	FP_OP(OP_fcvtns, 1),
+	FP_OP(OP_fcvtnu, 1),
+	FP_OP(OP_fcvtps, 1),
+	FP_OP(OP_fcvtpu, 1),
+	FP_OP(OP_fcvtxn, 1),
+	FP_OP(OP_fcvtxn2, 1),
+	FP_OP(OP_fcvtzs, 1),
+	FP_OP(OP_fcvtzu, 1),
+	FP_OP(OP_scvtf, 1),
+	FP_OP(OP_ucvtf, 1),
+	FP_OP(OP_frinta, 1),
+	FP_OP(OP_frinti, 1),
+	FP_OP(OP_frintm, 1),
+	FP_OP(OP_frintn, 1),
+	FP_OP(OP_frintp, 1),
+	FP_OP(OP_frintx, 1),
+	FP_OP(OP_frintz, 1),
+	// Reductions across the lanes of a vector
+	FP_ACROSS(OP_fmaxnmv, 1),
+	FP_ACROSS(OP_fmaxv, 1),
+	FP_ACROSS(OP_fminnmv, 1),
+	FP_ACROSS(OP_fminv, 1),
+	// Fused operations: complex ones multiply and add each element once as well
+	FP_OP(OP_fcmla, 2),
+	FP_OP(OP_fmadd, 2),
+	FP_OP(OP_fmla, 2),
+	FP_OP(OP_fmlal, 2),
+	FP_OP(OP_fmlal2, 2),
+	FP_OP(OP_fmls, 2),
+	FP_OP(OP_fmlsl, 2),
+	FP_OP(OP_fmlsl2, 2),
+	FP_OP(OP_fmsub, 2),
+	FP_OP(OP_fnmadd, 2),
+	FP_OP(OP_fnmsub, 2),
+	FP_OP(OP_fnmul, 2),
+	// SVE only forms: the predicated ones count their active lanes at runtime (see active_lanes.hpp)
+	FP_OP(OP_fadda, 1),
+	FP_ACROSS(OP_faddv, 1),
+	FP_OP(OP_fdivr, 1),
+	FP_OP(OP_fscale, 1),
+	FP_OP(OP_fsubr, 1),
+	FP_OP(OP_fmad, 2),
+	FP_OP(OP_fmsb, 2),
+	FP_OP(OP_fnmad, 2),
+	FP_OP(OP_fnmla, 2),
+	FP_OP(OP_fnmls, 2),
+	FP_OP(OP_fnmsb, 2),
+};
+#endif
+
+
+#ifdef FLOATING_POINTS_X86
+static constexpr fp_opcode_t fp_opcodes[] = {
+	/* SSE */
+	FP_OP(OP_ucomiss, 1),
+	FP_OP(OP_ucomisd, 1),
+	FP_OP(OP_comiss, 1),
+	FP_OP(OP_comisd, 1),
+	FP_PS(OP_sqrtps, 1),
+	FP_OP(OP_sqrtss, 1),
+	FP_PD(OP_sqrtpd, 1),
+	FP_OP(OP_sqrtsd, 1),
+	FP_PS(OP_rsqrtps, 1),
+	FP_OP(OP_rsqrtss, 1),
+	FP_PS(OP_rcpps, 1),
+	FP_OP(OP_rcpss, 1),
+	FP_PS(OP_addps, 1),
+	FP_OP(OP_addss, 1),
+	FP_PD(OP_addpd, 1),
+	FP_OP(OP_addsd, 1),
+	FP_PS(OP_mulps, 1),
+	FP_OP(OP_mulss, 1),
+	FP_PD(OP_mulpd, 1),
+	FP_OP(OP_mulsd, 1),
+	FP_PS(OP_subps, 1),
+	FP_OP(OP_subss, 1),
+	FP_PD(OP_subpd, 1),
+	FP_OP(OP_subsd, 1),
+	FP_PS(OP_minps, 1),
+	FP_OP(OP_minss, 1),
+	FP_PD(OP_minpd, 1),
+	FP_OP(OP_minsd, 1),
+	FP_PS(OP_divps, 1),
+	FP_OP(OP_divss, 1),
+	FP_PD(OP_divpd, 1),
+	FP_OP(OP_divsd, 1),
+	FP_PS(OP_maxps, 1),
+	FP_OP(OP_maxss, 1),
+	FP_PD(OP_maxpd, 1),
+	FP_OP(OP_maxsd, 1),
+	FP_PS(OP_cmpps, 1),
+	FP_OP(OP_cmpss, 1),
+	FP_PD(OP_cmppd, 1),
+	FP_OP(OP_cmpsd, 1),
+
+	/* x87 */
+	FP_OP(OP_fadd, 1),
+	FP_OP(OP_fmul, 1),
+	FP_OP(OP_fcom, 1),
+	FP_OP(OP_fcomp, 1),
+	FP_OP(OP_fsub, 1),
+	FP_OP(OP_fsubr, 1),
+	FP_OP(OP_fdiv, 1),
+	FP_OP(OP_fdivr, 1),
+	FP_OP(OP_fiadd, 1),
+	FP_OP(OP_fimul, 1),
+	FP_OP(OP_ficom, 1),
+	FP_OP(OP_ficomp, 1),
+	FP_OP(OP_fisub, 1),
+	FP_OP(OP_fisubr, 1),
+	FP_OP(OP_fidiv, 1),
+	FP_OP(OP_fidivr, 1),
+	FP_OP(OP_fchs, 1),
+	FP_OP(OP_fabs, 1),
+	FP_OP(OP_ftst, 1),
+	FP_OP(OP_f2xm1, 1),
+	FP_OP(OP_fyl2x, 1),
+	FP_OP(OP_fptan, 1),
+	FP_OP(OP_fpatan, 1),
+	FP_OP(OP_fxtract, 1),
+	FP_OP(OP_fprem1, 1),
+	FP_OP(OP_fprem, 1),
+	FP_OP(OP_fyl2xp1, 1),
+	FP_OP(OP_fsqrt, 1),
+	FP_OP(OP_fsincos, 1),
+	FP_OP(OP_frndint, 1),
+	FP_OP(OP_fscale, 1),
+	FP_OP(OP_fsin, 1),
+	FP_OP(OP_fcos, 1),
+	FP_OP(OP_fucompp, 1),
+	FP_OP(OP_fucomi, 1),
+	FP_OP(OP_fcomi, 1),
+	FP_OP(OP_fucom, 1),
+	FP_OP(OP_fucomp, 1),
+	FP_OP(OP_faddp, 1),
+	FP_OP(OP_fmulp, 1),
+	FP_OP(OP_fcompp, 1),
+	FP_OP(OP_fsubrp, 1),
+	FP_OP(OP_fsubp, 1),
+	FP_OP(OP_fdivrp, 1),
+	FP_OP(OP_fdivp, 1),
+	FP_OP(OP_fucomip, 1),
+	FP_OP(OP_fcomip, 1),
+
+	/* SSE3/SSE4 */
+	FP_PD(OP_haddpd, 1),
+	FP_PS(OP_haddps, 1),
+	FP_PD(OP_hsubpd, 1),
+	FP_PS(OP_hsubps, 1),
+	FP_PD(OP_addsubpd, 1),
+	FP_PS(OP_addsubps, 1),
+	FP_PS(OP_roundps, 1),
+	FP_PD(OP_roundpd, 1),
+	FP_OP(OP_roundss, 1),
+	FP_OP(OP_roundsd, 1),
+	// A multiplication and an addition per lane
+	FP_PS(OP_dpps, 2),
+	FP_PD(OP_dppd, 2),
+
+	/* AVX: the same operations on xmm and ymm, and on zmm with AVX-512 */
+	FP_OP(OP_vucomiss, 1),
+	FP_OP(OP_vucomisd, 1),
+	FP_OP(OP_vcomiss, 1),
+	FP_OP(OP_vcomisd, 1),
+	FP_PS(OP_vsqrtps, 1),
+	FP_OP(OP_vsqrtss, 1),
+	FP_PD(OP_vsqrtpd, 1),
+	FP_OP(OP_vsqrtsd, 1),
+	FP_PS(OP_vrsqrtps, 1),
+	FP_OP(OP_vrsqrtss, 1),
+	FP_PS(OP_vrcpps, 1),
+	FP_OP(OP_vrcpss, 1),
+	FP_PS(OP_vaddps, 1),
+	FP_OP(OP_vaddss, 1),
+	FP_PD(OP_vaddpd, 1),
+	FP_OP(OP_vaddsd, 1),
+	FP_PS(OP_vmulps, 1),
+	FP_OP(OP_vmulss, 1),
+	FP_PD(OP_vmulpd, 1),
+	FP_OP(OP_vmulsd, 1),
+	FP_PS(OP_vsubps, 1),
+	FP_OP(OP_vsubss, 1),
+	FP_PD(OP_vsubpd, 1),
+	FP_OP(OP_vsubsd, 1),
+	FP_PS(OP_vminps, 1),
+	FP_OP(OP_vminss, 1),
+	FP_PD(OP_vminpd, 1),
+	FP_OP(OP_vminsd, 1),
+	FP_PS(OP_vdivps, 1),
+	FP_OP(OP_vdivss, 1),
+	FP_PD(OP_vdivpd, 1),
+	FP_OP(OP_vdivsd, 1),
+	FP_PS(OP_vmaxps, 1),
+	FP_OP(OP_vmaxss, 1),
+	FP_PD(OP_vmaxpd, 1),
+	FP_OP(OP_vmaxsd, 1),
+	FP_PS(OP_vcmpps, 1),
+	FP_OP(OP_vcmpss, 1),
+	FP_PD(OP_vcmppd, 1),
+	FP_OP(OP_vcmpsd, 1),
+	FP_PD(OP_vhaddpd, 1),
+	FP_PS(OP_vhaddps, 1),
+	FP_PD(OP_vhsubpd, 1),
+	FP_PS(OP_vhsubps, 1),
+	FP_PD(OP_vaddsubpd, 1),
+	FP_PS(OP_vaddsubps, 1),
+	FP_PS(OP_vroundps, 1),
+	FP_PD(OP_vroundpd, 1),
+	FP_OP(OP_vroundss, 1),
+	FP_OP(OP_vroundsd, 1),
+	FP_PS(OP_vdpps, 2),
+	FP_PD(OP_vdppd, 2),
+
+	/* AVX-512 */
+	FP_PS(OP_vrcp14ps, 1),
+	FP_PD(OP_vrcp14pd, 1),
+	FP_OP(OP_vrcp14ss, 1),
+	FP_OP(OP_vrcp14sd, 1),
+	FP_PS(OP_vrsqrt14ps, 1),
+	FP_PD(OP_vrsqrt14pd, 1),
+	FP_OP(OP_vrsqrt14ss, 1),
+	FP_OP(OP_vrsqrt14sd, 1),
+	FP_PS(OP_vscalefps, 1),
+	FP_PD(OP_vscalefpd, 1),
+	FP_OP(OP_vscalefss, 1),
+	FP_OP(OP_vscalefsd, 1),
+
+	/* FMA: a multiplication and an addition per lane */
+	FP_PS(OP_vfmadd132ps, 2),
+	FP_PD(OP_vfmadd132pd, 2),
+	FP_PS(OP_vfmadd213ps, 2),
+	FP_PD(OP_vfmadd213pd, 2),
+	FP_PS(OP_vfmadd231ps, 2),
+	FP_PD(OP_vfmadd231pd, 2),
+	FP_OP(OP_vfmadd132ss, 2),
+	FP_OP(OP_vfmadd132sd, 2),
+	FP_OP(OP_vfmadd213ss, 2),
+	FP_OP(OP_vfmadd213sd, 2),
+	FP_OP(OP_vfmadd231ss, 2),
+	FP_OP(OP_vfmadd231sd, 2),
+	FP_PS(OP_vfmaddsub132ps, 2),
+	FP_PD(OP_vfmaddsub132pd, 2),
+	FP_PS(OP_vfmaddsub213ps, 2),
+	FP_PD(OP_vfmaddsub213pd, 2),
+	FP_PS(OP_vfmaddsub231ps, 2),
+	FP_PD(OP_vfmaddsub231pd, 2),
+	FP_PS(OP_vfmsubadd132ps, 2),
+	FP_PD(OP_vfmsubadd132pd, 2),
+	FP_PS(OP_vfmsubadd213ps, 2),
+	FP_PD(OP_vfmsubadd213pd, 2),
+	FP_PS(OP_vfmsubadd231ps, 2),
+	FP_PD(OP_vfmsubadd231pd, 2),
+	FP_PS(OP_vfmsub132ps, 2),
+	FP_PD(OP_vfmsub132pd, 2),
+	FP_PS(OP_vfmsub213ps, 2),
+	FP_PD(OP_vfmsub213pd, 2),
+	FP_PS(OP_vfmsub231ps, 2),
+	FP_PD(OP_vfmsub231pd, 2),
+	FP_OP(OP_vfmsub132ss, 2),
+	FP_OP(OP_vfmsub132sd, 2),
+	FP_OP(OP_vfmsub213ss, 2),
+	FP_OP(OP_vfmsub213sd, 2),
+	FP_OP(OP_vfmsub231ss, 2),
+	FP_OP(OP_vfmsub231sd, 2),
+	FP_PS(OP_vfnmadd132ps, 2),
+	FP_PD(OP_vfnmadd132pd, 2),
+	FP_PS(OP_vfnmadd213ps, 2),
+	FP_PD(OP_vfnmadd213pd, 2),
+	FP_PS(OP_vfnmadd231ps, 2),
+	FP_PD(OP_vfnmadd231pd, 2),
+	FP_OP(OP_vfnmadd132ss, 2),
+	FP_OP(OP_vfnmadd132sd, 2),
+	FP_OP(OP_vfnmadd213ss, 2),
+	FP_OP(OP_vfnmadd213sd, 2),
+	FP_OP(OP_vfnmadd231ss, 2),
+	FP_OP(OP_vfnmadd231sd, 2),
+	FP_PS(OP_vfnmsub132ps, 2),
+	FP_PD(OP_vfnmsub132pd, 2),
+	FP_PS(OP_vfnmsub213ps, 2),
+	FP_PD(OP_vfnmsub213pd, 2),
+	FP_PS(OP_vfnmsub231ps, 2),
+	FP_PD(OP_vfnmsub231pd, 2),
+	FP_OP(OP_vfnmsub132ss, 2),
+	FP_OP(OP_vfnmsub132sd, 2),
+	FP_OP(OP_vfnmsub213ss, 2),
+	FP_OP(OP_vfnmsub213sd, 2),
+	FP_OP(OP_vfnmsub231ss, 2),
+	FP_OP(OP_vfnmsub231sd, 2),
+};
+#endif
+
+
+// The opcodes listed above, indexed by opcode
+typedef struct _fp_table_t {
+	fp_op_t ops[OP_LAST];
+} fp_table_t;
+
+static constexpr fp_table_t
+make_fp_table(void)
+{
+	fp_table_t table = {};
+	for(const fp_opcode_t &entry : fp_opcodes)
+		table.ops[entry.opcode] = entry.op;
+	return table;
+}
+
+static constexpr bool
+fp_opcodes_unique(void)
+{
+	const int count = sizeof(fp_opcodes) / sizeof(fp_opcodes[0]);
+	for(int i = 0; i < count; i++){
+		for(int j = i + 1; j < count; j++){
+			if(fp_opcodes[i].opcode == fp_opcodes[j].opcode)
+				return false;
+		}
+	}
+	return true;
+}
+
+static_assert(fp_opcodes_unique(), "An opcode is listed twice in the FP opcode table");
+
+static constexpr fp_table_t fp_table = make_fp_table();
+
+// Operations per lane and element width of the given opcode
+static inline fp_op_t
+get_fp_op(int opcode)
+{
+	if(opcode < 0 || opcode >= OP_LAST)
+		return fp_op_t{0, 0, false};
+	return fp_table.ops[opcode];
+}
+
+
+#endif
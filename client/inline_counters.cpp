@@ -0,0 +1,91 @@
+#include "inline_counters.hpp"
+#include "drreg.h"
+
+#define MINSERT instrlist_meta_preinsert
+
+
+#ifdef X86
+// On x86 the raw TLS slot can be used straight as a memory operand:
+// a single 'add %seg:offs, imm32' per counter, we only need to preserve the flags.
+static void
+insert_counter_add(void *drcontext, instrlist_t *ilist, instr_t *where, int slot, ptr_int_t value)
+{
+    MINSERT(ilist, where,
+            INSTR_CREATE_add(drcontext,
+                             opnd_create_far_base_disp(tls_seg, DR_REG_NULL, DR_REG_NULL, 0,
+                                                       TLS_OFFS(slot), OPSZ_PTR),
+                             OPND_CREATE_INT32((int)value)));
+}
+#else
+// On AArch64 the TLS slot has to go through a register: load, add, store back.
+static void
+insert_counter_add(void *drcontext, instrlist_t *ilist, instr_t *where, int slot, ptr_int_t value,
+                   reg_id_t reg_cnt, reg_id_t reg_val)
+{
+    dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg, TLS_OFFS(slot), reg_cnt);
+    instrlist_insert_mov_immed_ptrsz(drcontext, value, opnd_create_reg(reg_val),
+                                     ilist, where, NULL, NULL);
+    MINSERT(ilist, where,
+            XINST_CREATE_add(drcontext, opnd_create_reg(reg_cnt), opnd_create_reg(reg_val)));
+    dr_insert_write_raw_tls(drcontext, ilist, where, tls_seg, TLS_OFFS(slot), reg_cnt);
+}
+#endif
+
+
+void
+insert_counters_update(void *drcontext, instrlist_t *ilist, instr_t *where,
+                       const counter_update_t *updates, int num_updates)
+{
+    bool needed = false;
+    for (int i = 0; i < num_updates; i++)
+        needed = needed || updates[i].value != 0;
+    if (!needed)
+        return;
+
+#ifdef X86
+    if (drreg_reserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS) {
+        DR_ASSERT(false); /* cannot recover */
+        return;
+    }
+    for (int i = 0; i < num_updates; i++) {
+        if (updates[i].value != 0)
+            insert_counter_add(drcontext, ilist, where, updates[i].slot, updates[i].value);
+    }
+    if (drreg_unreserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+#else
+    reg_id_t reg_cnt, reg_val;
+    if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_cnt) != DRREG_SUCCESS ||
+        drreg_reserve_register(drcontext, ilist, where, NULL, &reg_val) != DRREG_SUCCESS) {
+        DR_ASSERT(false); /* cannot recover */
+        return;
+    }
+    for (int i = 0; i < num_updates; i++) {
+        if (updates[i].value != 0)
+            insert_counter_add(drcontext, ilist, where, updates[i].slot, updates[i].value,
+                               reg_cnt, reg_val);
+    }
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_cnt) != DRREG_SUCCESS ||
+        drreg_unreserve_register(drcontext, ilist, where, reg_val) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+#endif
+}
+
+
+void
+insert_counter_add_reg(void *drcontext, instrlist_t *ilist, instr_t *where, int slot,
+                       reg_id_t reg_value, reg_id_t reg_scratch)
+{
+#ifdef X86
+    MINSERT(ilist, where,
+            INSTR_CREATE_add(drcontext,
+                             opnd_create_far_base_disp(tls_seg, DR_REG_NULL, DR_REG_NULL, 0,
+                                                       TLS_OFFS(slot), OPSZ_PTR),
+                             opnd_create_reg(reg_value)));
+#else
+    dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg, TLS_OFFS(slot), reg_scratch);
+    MINSERT(ilist, where,
+            XINST_CREATE_add(drcontext, opnd_create_reg(reg_scratch), opnd_create_reg(reg_value)));
+    dr_insert_write_raw_tls(drcontext, ilist, where, tls_seg, TLS_OFFS(slot), reg_scratch);
+#endif
+}
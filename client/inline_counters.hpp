@@ -0,0 +1,32 @@
+#ifndef INLINE_COUNTERS_H
+#define INLINE_COUNTERS_H
+
+
+#include "dr_api.h"
+#include "thread_data.hpp"
+
+/* Inline counting support.
+ * Instead of paying a clean call per basic block, each block adds its FP and
+ * read/write byte totals (computed once, at block build time) straight into
+ * per-thread counters living in raw TLS (see MEMTRACE_TLS_OFFS_* in thread_data.hpp).
+ * ThreadData then just takes the difference of those counters across a ROI.
+ * */
+
+typedef struct _counter_update_t {
+	int slot;          // MEMTRACE_TLS_OFFS_* slot to update
+	ptr_int_t value;   // Value to add to the slot
+} counter_update_t;
+
+// Inserts, before 'where', the inline code adding each value to its TLS counter.
+// Updates with a zero value are skipped.
+void insert_counters_update(void *drcontext, instrlist_t *ilist, instr_t *where,
+		const counter_update_t *updates, int num_updates);
+
+// Inserts, before 'where', the inline code adding the value held in reg_value to the given TLS counter.
+// The caller is in charge of reserving the registers (and the arithmetic flags on x86).
+// reg_scratch is not used on x86.
+void insert_counter_add_reg(void *drcontext, instrlist_t *ilist, instr_t *where,
+		int slot, reg_id_t reg_value, reg_id_t reg_scratch);
+
+
+#endif
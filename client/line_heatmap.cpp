@@ -0,0 +1,75 @@
+#include "line_heatmap.hpp"
+#include "symbols.hpp"
+
+// Instructions of each built block, by block tag, and source line of each pc already resolved
+static std::unordered_map<app_pc, std::vector<heatmap_instr_t>> blocks;
+static std::unordered_map<app_pc, std::string> pc_lines;
+static void *heatmap_lock;
+
+
+void line_heatmap_init(void){
+	heatmap_lock = dr_mutex_create();
+}
+
+
+void line_heatmap_exit(void){
+	dr_mutex_destroy(heatmap_lock);
+}
+
+
+void line_heatmap_register_block(app_pc tag, std::vector<heatmap_instr_t> instrs){
+	dr_mutex_lock(heatmap_lock);
+	// A block built again (e.g. after a flush) has the very same instructions. Traces, sharing the tag of
+	// their head block, are ended right after it (see per_block_callouts): they have the same instructions too.
+	blocks[tag] = std::move(instrs);
+	dr_mutex_unlock(heatmap_lock);
+}
+
+
+// "file:line" of the given pc, "<module>+offset" without line information. heatmap_lock must be held.
+static std::string get_line(app_pc pc){
+	auto it = pc_lines.find(pc);
+	if(it != pc_lines.end())
+		return it->second;
+
+	pc_symbol_t symbol;
+	lookup_pc_symbol(pc, &symbol);
+	std::string line = source_location(symbol);
+	pc_lines[pc] = line;
+	return line;
+}
+
+
+void LineHeatmap::add_block_execution(app_pc tag){
+	block_executions[tag]++;
+}
+
+
+void LineHeatmap::add_bytes(app_pc pc, unsigned long long bytes){
+	pc_bytes[pc] += bytes;
+}
+
+
+void LineHeatmap::save(Point &point){
+	dr_mutex_lock(heatmap_lock);
+	for(auto &block : block_executions){
+		auto instrs = blocks.find(block.first);
+		if(instrs == blocks.end())
+			continue;
+		for(auto &instr : instrs->second){
+			line_counters_t &line = point.lines[get_line(instr.pc)];
+			line.executions += block.second;
+			line.flops += instr.fp_count * block.second;
+		}
+	}
+	for(auto &pc : pc_bytes)
+		point.lines[get_line(pc.first)].bytes += pc.second;
+	dr_mutex_unlock(heatmap_lock);
+	clear();
+}
+
+
+void LineHeatmap::clear(void){
+	block_executions.clear();
+	pc_bytes.clear();
+}
@@ -0,0 +1,45 @@
+#ifndef LINE_HEATMAP_H
+#define LINE_HEATMAP_H
+
+
+#include "dr_api.h"
+#include "point.hpp"
+#include <unordered_map>
+#include <vector>
+
+/* Source line heatmap (--line_heatmap).
+ * When a block is built, the pc and FP operations of each of its instructions are
+ * registered in a table shared by all the threads. At runtime each thread counts,
+ * in a per-ROI hash table, the executions of each block and the bytes accessed by
+ * each pc (taken from the address-carrying memory reference entries).
+ * When the ROI ends, pcs are mapped to source lines through the drsyms line
+ * information, and the per-line totals are stored in the point.
+ * */
+
+void line_heatmap_init(void);
+void line_heatmap_exit(void);
+
+typedef struct _heatmap_instr_t {
+	app_pc pc;
+	int fp_count;  // FP operations of the instruction (see count_fp.hpp), 0 for the masked ones
+} heatmap_instr_t;
+
+// Build time: registers the instructions of the block starting at tag
+void line_heatmap_register_block(app_pc tag, std::vector<heatmap_instr_t> instrs);
+
+
+class LineHeatmap{
+public:
+  void add_block_execution(app_pc tag);
+  void add_bytes(app_pc pc, unsigned long long bytes);
+  // Moves the per-pc counters gathered so far into the given point, by source line
+  void save(Point &point);
+  void clear(void);
+
+private:
+  std::unordered_map<app_pc, unsigned long long> block_executions;
+  std::unordered_map<app_pc, unsigned long long> pc_bytes;
+};
+
+
+#endif
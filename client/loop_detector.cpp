@@ -0,0 +1,247 @@
+#include "loop_detector.hpp"
+#include "timer.hpp"
+#include "droption.h"
+#include "symbols.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+// Loops are never removed: their table is preallocated so that it can be read while being appended to.
+// So is the loop block table.
+#define MAX_LOOPS 8192
+#define MAX_LOOP_BLOCKS 16384
+#define MAX_BLOCK_HEADERS 8
+// Label of the whole program point, providing the time loop points get their share of
+#define PROGRAM_LABEL "__program__"
+
+extern droption_t<double> loop_threshold;
+
+typedef struct _loop_t {
+	app_pc header;
+	app_pc end;
+} loop_t;
+
+static loop_t loop_table[MAX_LOOPS];
+static volatile int num_loops = 0;
+
+// What the clean call of a block tells about it: its innermost loop and the loop headers it executes.
+// Blocks with the same description share their entry.
+typedef struct _loop_block_t {
+	int loop_id;
+	int num_headers;
+	int headers[MAX_BLOCK_HEADERS];
+	unsigned int headers_at_start;  // Bit h: headers[h] is the block start
+} loop_block_t;
+
+static loop_block_t loop_block_table[MAX_LOOP_BLOCKS];
+static volatile int num_loop_blocks = 0;
+static void *loops_lock;
+
+// Build time indexes, used with loops_lock held: the loops by header, the loop blocks by description
+static std::multimap<app_pc, int> loops_by_header;
+static std::map<std::vector<int>, int> loop_block_ids;
+
+// Process wide totals, filled as threads exit
+static std::unordered_map<int, loop_counters_t> total_loops;
+static unsigned long long total_instructions = 0;
+static double program_start;
+
+
+void loop_detector_init(void){
+	loops_lock = dr_mutex_create();
+	program_start = timer_wall_time();
+}
+
+
+void loop_detector_exit(void){
+	dr_mutex_destroy(loops_lock);
+}
+
+
+// Registers the loop, if new. loops_lock must be held.
+static void add_loop(app_pc header, app_pc end){
+	auto same_header = loops_by_header.equal_range(header);
+	for(auto it = same_header.first; it != same_header.second; ++it){
+		if(loop_table[it->second].end == end)
+			return;
+	}
+	if(num_loops == MAX_LOOPS){
+		dr_printf("> WARNING: Too many loops detected, ignoring the loop @" PFX "\n", header);
+		return;
+	}
+	loop_table[num_loops] = loop_t{header, end};
+	loops_by_header.emplace(header, num_loops);
+	num_loops++;
+#ifdef VALIDATE
+	dr_printf("> Loop detected [" PFX ", " PFX ")\n", header, end);
+#endif
+	// Blocks of the body built so far don't know they belong to the loop: rebuild them
+	dr_delay_flush_region(header, end - header, 0, NULL);
+}
+
+
+// Entry of the loop block table with the given description, added if new. loops_lock must be held.
+static int get_loop_block(const loop_block_t &block){
+	std::vector<int> description = {block.loop_id, (int)block.headers_at_start};
+	description.insert(description.end(), block.headers, block.headers + block.num_headers);
+	auto it = loop_block_ids.find(description);
+	if(it != loop_block_ids.end())
+		return it->second;
+	if(num_loop_blocks == MAX_LOOP_BLOCKS){
+		dr_printf("> WARNING: Too many loop blocks, a block won't be attributed to its loop\n");
+		return NO_LOOP_BLOCK;
+	}
+	loop_block_table[num_loop_blocks] = block;
+	loop_block_ids[description] = num_loop_blocks;
+	return num_loop_blocks++;
+}
+
+
+// Start of the function holding pc: that of its module without symbols, NULL outside any module
+static app_pc get_function_start(app_pc pc){
+	pc_symbol_t symbol;
+	if(lookup_pc_symbol(pc, &symbol))
+		return pc - symbol.module_offs + symbol.function_offs;
+	return symbol.module.empty() ? NULL : pc - symbol.module_offs;
+}
+
+
+int loop_detector_register_block(app_pc start, instrlist_t *bb){
+	instr_t *last = instrlist_last_app(bb);
+	app_pc last_pc = last != NULL ? instr_get_app_pc(last) : start;
+	// Loops don't cross function boundaries: those containing the block have their header in its function
+	app_pc function_start = get_function_start(start);
+	app_pc back_edge_target = NULL;
+	if(last != NULL && (instr_is_cbr(last) || instr_is_ubr(last)) && opnd_is_pc(instr_get_target(last))){
+		app_pc target = opnd_get_pc(instr_get_target(last));
+		// Tail calls jump backwards too, to another function
+		if(target <= last_pc && get_function_start(target) == function_start)
+			back_edge_target = target;
+	}
+
+	dr_mutex_lock(loops_lock);
+	if(back_edge_target != NULL)
+		add_loop(back_edge_target, last_pc + instr_length(dr_get_current_drcontext(), last));
+
+	loop_block_t block = {NO_LOOP, 0, {}, 0};
+	// Headers executed by the block, at its start or falling through into the loop
+	for(auto it = loops_by_header.lower_bound(start); it != loops_by_header.end() && it->first <= last_pc; ++it){
+		if(block.num_headers < MAX_BLOCK_HEADERS){
+			if(it->first == start)
+				block.headers_at_start |= 1u << block.num_headers;
+			block.headers[block.num_headers++] = it->second;
+		}
+	}
+	// Innermost loop containing the block
+	for(auto it = loops_by_header.upper_bound(start); it != loops_by_header.begin();){
+		--it;
+		if(it->first < function_start)
+			break;
+		const loop_t &loop = loop_table[it->second];
+		if(start >= loop.end)
+			continue;
+		if(block.loop_id == NO_LOOP || loop.end - loop.header < loop_table[block.loop_id].end - loop_table[block.loop_id].header)
+			block.loop_id = it->second;
+	}
+	int loop_block = block.loop_id == NO_LOOP && block.num_headers == 0 ? NO_LOOP_BLOCK : get_loop_block(block);
+	dr_mutex_unlock(loops_lock);
+	return loop_block;
+}
+
+
+LoopProfile::LoopProfile(){
+	cur_loop = NO_LOOP;
+	prev_last_pc = NULL;
+	instructions = 0;
+}
+
+
+void LoopProfile::enter_block(int loop_block, app_pc last_pc){
+	cur_loop = NO_LOOP;
+	if(loop_block != NO_LOOP_BLOCK){
+		const loop_block_t &block = loop_block_table[loop_block];
+		for(int h = 0; h < block.num_headers; h++){
+			const loop_t &header_loop = loop_table[block.headers[h]];
+			loop_counters_t &loop = loops[block.headers[h]];
+			loop.iterations++;
+			// A header inside the block is reached from the block start, out of the loop
+			if(!(block.headers_at_start & (1u << h)) ||
+			   prev_last_pc < header_loop.header || prev_last_pc >= header_loop.end)
+				loop.entries++;
+		}
+		cur_loop = block.loop_id;
+	}
+	prev_last_pc = last_pc;
+}
+
+
+void LoopProfile::attribute(const call_graph_counters_t &counters){
+	instructions += counters.instructions;
+	if(cur_loop != NO_LOOP)
+		loops[cur_loop].counters.add(counters);
+}
+
+
+void LoopProfile::merge_into_totals(void){
+	dr_mutex_lock(loops_lock);
+	for(auto &entry : loops){
+		loop_counters_t &total = total_loops[entry.first];
+		total.counters.add(entry.second.counters);
+		total.iterations += entry.second.iterations;
+		total.entries += entry.second.entries;
+	}
+	total_instructions += instructions;
+	dr_mutex_unlock(loops_lock);
+	loops.clear();
+	instructions = 0;
+}
+
+
+void loop_detector_dump(file_t out_file, bool timing){
+	if(timing){
+		dr_fprintf(out_file, "<point label=\"%s\">\n", PROGRAM_LABEL);
+		dr_fprintf(out_file, "<time>%.9f</time>\n", timer_wall_time() - program_start);
+		dr_fprintf(out_file, "</point>\n");
+		return;
+	}
+
+	dr_mutex_lock(loops_lock);
+	for(int i = 0; i < num_loops; i++){
+		// Inclusive totals: the loop itself and the loops nested in it
+		call_graph_counters_t inclusive = {0, 0, 0, 0, 0};
+		for(int j = 0; j < num_loops; j++){
+			if(loop_table[j].header >= loop_table[i].header && loop_table[j].end <= loop_table[i].end &&
+			   total_loops.find(j) != total_loops.end())
+				inclusive.add(total_loops[j].counters);
+		}
+		double fraction = total_instructions > 0 ? (double)inclusive.instructions / total_instructions : 0.0;
+		if(fraction * 100.0 < loop_threshold.get_value() || inclusive.instructions == 0)
+			continue;
+
+		loop_counters_t &loop = total_loops[i];
+		pc_symbol_t start, end;
+		lookup_pc_symbol(loop_table[i].header, &start);
+		lookup_pc_symbol(loop_table[i].end - 1, &end);
+
+		// Without line information, the loop is located by its header
+		std::string location = start.file.empty() ? source_location(start) :
+			start.file + ":" + std::to_string(start.line) + "-" + std::to_string(end.line);
+		dr_fprintf(out_file, "<point label=\"loop%d@%s\">\n", i, xml_escape(location).c_str());
+		dr_fprintf(out_file, "<flops>%llu</flops>\n", inclusive.flops);
+		dr_fprintf(out_file, "<bytes>%llu</bytes>\n", inclusive.bytes);
+		dr_fprintf(out_file, "<read_bytes>%llu</read_bytes>\n", inclusive.read_bytes);
+		dr_fprintf(out_file, "<write_bytes>%llu</write_bytes>\n", inclusive.write_bytes);
+		dr_fprintf(out_file, "<src_file_start>%s</src_file_start>\n", xml_escape(start.file).c_str());
+		dr_fprintf(out_file, "<src_file_end>%s</src_file_end>\n", xml_escape(end.file).c_str());
+		dr_fprintf(out_file, "<line_n_start>%u</line_n_start>\n", start.line);
+		dr_fprintf(out_file, "<line_n_end>%u</line_n_end>\n", end.line);
+		dr_fprintf(out_file, "<iterations>%llu</iterations>\n", loop.iterations);
+		dr_fprintf(out_file, "<entries>%llu</entries>\n", loop.entries);
+		dr_fprintf(out_file, "<trip_count>%f</trip_count>\n",
+				loop.entries > 0 ? (double)loop.iterations / loop.entries : 0.0);
+		dr_fprintf(out_file, "<parent>%s</parent>\n", PROGRAM_LABEL);
+		dr_fprintf(out_file, "<instr_fraction>%f</instr_fraction>\n", fraction);
+		dr_fprintf(out_file, "</point>\n");
+	}
+	dr_mutex_unlock(loops_lock);
+}
@@ -0,0 +1,71 @@
+#ifndef LOOP_DETECTOR_H
+#define LOOP_DETECTOR_H
+
+
+#include "dr_api.h"
+#include "point.hpp"
+#include <unordered_map>
+
+/* Automatic loop detection (--detect_loops).
+ * Loops are detected as blocks are built: a block ending with a direct branch jumping
+ * backwards, to a header at a lower address within its function (within its module without
+ * symbols, tail calls jumping backwards too), closes the loop [header, branch end).
+ * When a new loop is found, the code it spans is flushed, so that the blocks of its body
+ * which have already been built get rebuilt knowing they belong to it.
+ * Each block is attributed to the innermost loop containing it.
+ * At runtime, each thread counts per loop:
+ * - the iterations, i.e. the executions of the loop header;
+ * - the entries, i.e. the executions of the header coming from outside the loop;
+ * - flops, bytes and executed instructions of the blocks within it (exclusive).
+ * A header is not necessarily a block start: falling through into a loop, the block entering it
+ * runs on past its header. Each block thus lists the headers it executes, at its start or inside it.
+ * Reaching a header at its start, the block enters the loop when the previous block ended out of it;
+ * inside it, the block always enters the loop, coming from its own start, before the header.
+ * At exit, nested loops are added to the loops containing them, and every loop executing
+ * at least --loop_threshold percent of the program instructions becomes a point.
+ * */
+
+#define NO_LOOP -1
+#define NO_LOOP_BLOCK -1
+
+void loop_detector_init(void);
+void loop_detector_exit(void);
+
+// Build time: detects a loop closed by the block starting at start. Returns the entry of the
+// loop block table describing the block: the innermost loop containing its start and the headers
+// it executes. NO_LOOP_BLOCK when it is in no loop and executes no header.
+int loop_detector_register_block(app_pc start, instrlist_t *bb);
+
+
+// Counters of a loop, gathered by a thread
+typedef struct _loop_counters_t {
+	call_graph_counters_t counters;
+	unsigned long long iterations;
+	unsigned long long entries;
+} loop_counters_t;
+
+class LoopProfile{
+public:
+  LoopProfile();
+  // An executed block (see loop_detector_register_block), whose last instruction is at last_pc
+  void enter_block(int loop_block, app_pc last_pc);
+  // Attributes the given counters to the loop currently executing
+  void attribute(const call_graph_counters_t &counters);
+  // Adds what the thread gathered to the process wide totals
+  void merge_into_totals(void);
+
+private:
+  std::unordered_map<int, loop_counters_t> loops;
+  int cur_loop;
+  // Last instruction of the previous block: where the control flow came from
+  app_pc prev_last_pc;
+  // Instructions executed by the whole thread
+  unsigned long long instructions;
+};
+
+// Writes the points of the loops above the threshold. In timing documents, it writes the
+// program point instead, whose time loop points get their share of.
+void loop_detector_dump(file_t out_file, bool timing);
+
+
+#endif
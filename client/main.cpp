@@ -33,16 +33,27 @@
 
 // C++ libraries
 #include <list>
+#include <type_traits>
 #include "thread_data.hpp"
 #include "point.hpp"
 #include "count_fp.hpp"
+#include "inline_counters.hpp"
+#include "runtime_bytes.hpp"
+#include "active_lanes.hpp"
+#include "timer.hpp"
+#include "call_graph.hpp"
+#include "line_heatmap.hpp"
+#include "loop_detector.hpp"
+#include "cache_sim.hpp"
+#include "false_sharing.hpp"
+#include "allocations.hpp"
+#include "stack_traffic.hpp"
 
 // C libraries
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h> /* for offsetof */
-#include <sys/time.h> /* for timing information*/
 #include <inttypes.h> /* for printing uint64_t properly*/
 
 
@@ -53,6 +64,7 @@
 #include "drutil.h"
 #include "drwrap.h"
 #include "drsyms.h"
+#include "drx.h"
 #include "droption.h"
 
 
@@ -61,13 +73,19 @@ static client_id_t client_id;
 reg_id_t tls_seg;
 uint tls_offs;
 int tls_idx;
+drx_buf_t *mem_buf = NULL;
 
 // Region of interest data structures.
+// The ROI state lives in each ThreadData: these are only summed up on thread exit.
+static unsigned int roi_start_detected = 0;
+static unsigned int roi_end_detected = 0;
 
-
-static bool in_roi = false;
-static int roi_start_detected = 0;
-static int roi_end_detected = 0;
+// Points of the threads which have already exited: they are all merged
+// into a single output file at process exit.
+static std::list<thread_points_t> exited_threads;
+// Timed points, with --alternate_runs
+static std::list<thread_points_t> exited_time_threads;
+static void *exited_threads_lock;
 
 typedef struct{
 	std::string f_name;
@@ -78,13 +96,6 @@ typedef struct{
 
 
 
-// Get current time.
-// The function implementation the same as the ERT one.
-double get_time(){
-	struct timeval tm;
-	gettimeofday(&tm, NULL);
-	return tm.tv_sec + (tm.tv_usec / 1000000.0);
-}
 
 
 droption_t<bool> read_bytes_only(
@@ -100,6 +111,31 @@ droption_t<bool> write_bytes_only(
 		);
 
 
+droption_t<bool> inline_count(
+		DROPTION_SCOPE_CLIENT, "inline_count", false,
+		"Count FP operations and bytes with inline per-thread counters instead of clean calls",
+		"Each basic block adds its FP operations and read/written bytes, computed when the block is built, "
+		"straight into per-thread counters. This avoids a clean call per basic block and the memory reference buffer."
+		);
+
+
+static droption_t<unsigned int> buffer_entries(
+		DROPTION_SCOPE_CLIENT, "buffer_entries", MAX_NUM_MEM_REFS,
+		"Number of entries of the per-thread memory reference buffer",
+		"Number of entries of the per-thread memory reference buffer. Whenever it fills up between two clean calls, "
+		"it is drained automatically: bigger buffers just mean less frequent draining."
+		);
+
+
+static droption_t<bool> instrument_roi_only(
+		DROPTION_SCOPE_CLIENT, "instrument_roi_only", false,
+		"Instrument basic blocks only while a region of interest is open",
+		"Outside of any region of interest, basic blocks are built without instrumentation. "
+		"The code cache is flushed whenever the first region of interest opens and the last one closes, "
+		"so that code outside the regions of interest runs close to the DynamoRIO base overhead."
+		);
+
+
 droption_t<bool> time_run(
 		DROPTION_SCOPE_CLIENT, "time_run", false,
 		"Run the target application to gather timinng information only,",
@@ -131,10 +167,164 @@ static droption_t<std::string> trace_f(
 		"Trace the execution of the given function name. (Inlined functions not supported)\n");
 
 
+static droption_t<unsigned int> skip_calls(
+		DROPTION_SCOPE_CLIENT, "skip_calls", 0,
+		"Skip the first N ROI invocations (e.g. warmup iterations).\n Default value is 0 - Skip none",
+		"Skip the first N invocations of the ROI (or of the --trace_f function), counted over all the threads: "
+		"they are not recorded, as if out of any ROI. They still run instrumented code, whose counts are discarded, "
+		"unless --instrument_roi_only is given too.\n Default value is 0 - Skip none");
+
 static droption_t<int> up_to_call(
 		DROPTION_SCOPE_CLIENT, "up_to_call", 0,
 		"Trace function execution up to the specified call number.\n Default value is 0 - Trace all function calls",
-		"Trace function execution up to the specified call number.\n Default value is 0 - Trace all function calls");
+		"Trace the M ROI invocations following the --skip_calls ones. Once the last of them is over, the ROI delimiters "
+		"are unwrapped and the instrumented code flushed: the rest of the run goes at bare DynamoRIO speed.\n"
+		"Default value is 0 - Trace all function calls");
+
+
+static droption_t<unsigned int> sample_rate(
+		DROPTION_SCOPE_CLIENT, "sample_rate", 1,
+		"Record only 1 in N invocations of each ROI\n Default value is 1 - Record all of them",
+		"Record only 1 in N invocations of each ROI label (or of the --trace_f function), the other ones are left out as if out of any ROI: "
+		"they still run instrumented code, whose counts are discarded, unless --instrument_roi_only is given too. "
+		"Each label is then reported once, with flops and bytes extrapolated to all of its invocations, "
+		"together with the number of samples and the per-invocation variance. Time runs time every invocation.\n"
+		"Default value is 1 - Record all of them");
+
+static droption_t<bool> sample_random(
+		DROPTION_SCOPE_CLIENT, "sample_random", false,
+		"Sample each ROI invocation with probability 1/N, N being --sample_rate",
+		"Sample each ROI invocation with probability 1/N, N being --sample_rate, rather than every N-th invocation.");
+
+
+static droption_t<bool> alternate_runs(
+		DROPTION_SCOPE_CLIENT, "alternate_runs", false,
+		"Alternate timed and counted invocations of each ROI, writing both roofline.xml and roofline_time.xml in a single run",
+		"Alternate, within a single run, the invocations of each ROI label, three at a time: the first runs instrumented and is counted, "
+		"the second runs uninstrumented, rebuilding the code the counted one flushed, and is neither counted nor timed, "
+		"the third runs uninstrumented and is timed. Each label is reported once in both roofline.xml and roofline_time.xml, "
+		"flops, bytes and time being extrapolated to all of its invocations. Implies --instrument_roi_only. "
+		"As the code cache is shared, timed invocations run instrumented code while another thread runs a counted invocation.");
+
+
+static droption_t<bool> call_graph(
+		DROPTION_SCOPE_CLIENT, "call_graph", false,
+		"Attribute flops and bytes to the functions executed within each ROI",
+		"Attribute flops and bytes to the function enclosing each basic block, resolved with drsyms, keeping a shadow call stack per thread. "
+		"Each ROI then reports its call paths, and each function within it becomes a point of its own, labelled <ROI label>::<function>, "
+		"with its inclusive and exclusive totals. Not available with --inline_count.");
+
+
+static droption_t<bool> line_heatmap(
+		DROPTION_SCOPE_CLIENT, "line_heatmap", false,
+		"Report flops, bytes and executed instructions per source line within each ROI",
+		"Accumulate flops, bytes and executed instructions per application pc within each ROI, "
+		"and report them per source line (from the debug line information) in a <line> table of the point. "
+		"Runtime sized accesses are left out (see the README). Not available with --inline_count.");
+
+
+static droption_t<bool> detect_loops(
+		DROPTION_SCOPE_CLIENT, "detect_loops", false,
+		"Detect the hot loops of the whole run and report each of them as a point",
+		"Detect loops from the backward branches found as blocks are built, counting iterations, entries, flops and bytes "
+		"of each of them over the whole run. Every loop executing at least --loop_threshold percent of the instructions is "
+		"reported as a point of its own, with its source range. No ROI is needed. Not available with --inline_count nor --instrument_roi_only.");
+
+droption_t<double> loop_threshold(
+		DROPTION_SCOPE_CLIENT, "loop_threshold", 1.0,
+		"Minimum share of the executed instructions, in percent, of a loop reported by --detect_loops",
+		"Minimum share of the executed instructions, in percent, of a loop reported by --detect_loops. Default value is 1.0");
+
+
+static droption_t<bool> cache_sim(
+		DROPTION_SCOPE_CLIENT, "cache_sim", false,
+		"Simulate the data caches and report the bytes moved at each memory level",
+		"Record the accessed addresses and feed them to a per-thread model of the data cache hierarchy "
+		"(set-associative, LRU, write-back, write-allocate, non-temporal stores bypassing it). Each point then reports the "
+		"bytes accessed from L1, moved to and from each further level (the last one being the last level cache), and moved to and from memory. "
+		"Shared caches are simulated as if private to each thread, every thread holding the state of the whole hierarchy. "
+		"Runtime sized accesses are left out (see the README). "
+		"Not available with --inline_count, --read_bytes_only nor --write_bytes_only.");
+
+static droption_t<std::string> cache_config(
+		DROPTION_SCOPE_CLIENT, "cache_config", "",
+		"Cache hierarchy simulated by --cache_sim, e.g. 32K:8:64,1M:16:64",
+		"Cache hierarchy simulated by --cache_sim: <size>:<ways>:<line size> per level, from L1 on, comma separated, up to 4 levels. "
+		"By default it is read from /sys/devices/system/cpu/cpu0/cache.");
+
+
+static droption_t<bool> footprint(
+		DROPTION_SCOPE_CLIENT, "footprint", false,
+		"Report the distinct cache lines and pages touched by each ROI",
+		"Record the accessed addresses and report, for each ROI, the distinct 64 bytes lines, 4 KiB pages and 2 MiB pages "
+		"it touches, estimated through HyperLogLog sketches (about 0.8% error, up to 48 KiB per point). "
+		"Runtime sized accesses are left out (see the README). Not available with --inline_count.");
+
+static droption_t<bool> footprint_exact(
+		DROPTION_SCOPE_CLIENT, "footprint_exact", false,
+		"Count the --footprint exactly rather than estimating it",
+		"Keep the sets of the lines and pages touched by each ROI rather than estimating their number, for validating "
+		"the estimates. Memory grows with the footprint.");
+
+
+static droption_t<bool> reuse_distance(
+		DROPTION_SCOPE_CLIENT, "reuse_distance", false,
+		"Report a histogram of the reuse distances of the accesses of each ROI",
+		"Record the accessed addresses and compute the LRU stack distance of each access, in distinct 64 bytes lines, "
+		"reporting a log2 binned histogram per ROI: the miss ratio of a fully associative LRU cache of any size follows. "
+		"Lines are sampled by address hash (see --reuse_sample_rate). Runtime sized accesses are left out (see the README). "
+		"Not available with --inline_count.");
+
+static droption_t<double> reuse_sample_rate(
+		DROPTION_SCOPE_CLIENT, "reuse_sample_rate", 0.01,
+		"Share of the cache lines tracked by --reuse_distance",
+		"Share of the cache lines, picked by hashing their address, tracked by --reuse_distance: distances and counts "
+		"are scaled back by it. 1 tracks every line. Default value is 0.01");
+
+
+static droption_t<bool> access_patterns(
+		DROPTION_SCOPE_CLIENT, "access_patterns", false,
+		"Classify the memory instructions of each ROI as constant, unit stride, fixed stride or irregular",
+		"Follow the address stream of each memory instruction within the ROIs and classify it as constant address, "
+		"unit stride, fixed stride or irregular, from the distance between its consecutive accesses. Each point reports "
+		"its bytes per pattern, and the irregular instructions accessing the most bytes. Runtime sized accesses are left out "
+		"(see the README). Not available with --inline_count.");
+
+
+static droption_t<bool> alignment(
+		DROPTION_SCOPE_CLIENT, "alignment", false,
+		"Count the misaligned and cache line splitting accesses of each ROI",
+		"Record the accessed addresses and count, for each ROI, the accesses not aligned to their size, the ones spanning "
+		"more than one 64 bytes line and the extra lines they touch, reporting the instructions splitting lines the most. "
+		"Runtime sized accesses are left out (see the README). Not available with --inline_count.");
+
+
+static droption_t<bool> allocations(
+		DROPTION_SCOPE_CLIENT, "allocations", false,
+		"Attribute the bytes of each ROI to the allocation sites of the accessed blocks",
+		"Wrap malloc, calloc, realloc, aligned_alloc, posix_memalign, free and the global operators new and delete, keeping "
+		"the live heap blocks in an interval index. Bytes read and written within the ROIs are attributed to the allocation "
+		"site (the calling instruction) of the block they fall in; the rest (stack, globals, ...) is reported as unattributed. "
+		"Runtime sized accesses are left out (see the README). Not available with --inline_count.");
+
+
+static droption_t<bool> stack_bytes(
+		DROPTION_SCOPE_CLIENT, "stack_bytes", false,
+		"Split the bytes of each ROI into stack and non-stack ones, listing the spill candidates",
+		"Tag each memory operand, when its block is built, as stack relative (based on the stack or frame pointer) or not. "
+		"Each ROI reports its stack read and write bytes, and the explicit stack accesses (spills, reloads, locals) "
+		"accessing the most bytes: the non-stack bytes give an intensity free of register spills. With --inline_count, "
+		"the stack bytes are counted per block and no instruction is reported.");
+
+
+static droption_t<bool> false_sharing(
+		DROPTION_SCOPE_CLIENT, "false_sharing", false,
+		"Detect cache lines falsely shared among threads within the ROIs",
+		"Record, in a shadow table shared by all the threads, which bytes of each 64 bytes line each thread writes and reads "
+		"within the ROIs, and how many times the line moves between threads. Lines where a thread writes bytes another one "
+		"accesses, while neither of them touches bytes the other one writes, are reported with the threads, pcs and symbols "
+		"involved. Lines touched by a single thread take a small record, up to 4M lines; accesses to further lines are left out. "
+		"Runtime sized accesses are left out (see the README). Not available with --inline_count, --read_bytes_only nor --write_bytes_only.");
 
 
 static droption_t<bool> calls_as_separate_roi(
@@ -144,25 +334,156 @@ static droption_t<bool> calls_as_separate_roi(
 
 
 
+// --instrument_roi_only: number of regions of interest currently open, across all threads.
+// Basic blocks are built with instrumentation only while this is positive.
+static volatile int open_rois = 0;
+
+// With sampling, every invocation of a label is a sample of the same point
+static bool sampling_enabled(void){
+	return sample_rate.get_value() > 1;
+}
+
+// Whether each label is reported as a single point, built from samples of its invocations
+static bool per_label_points(void){
+	return sampling_enabled() || alternate_runs.get_value();
+}
+
+// Timed invocations must run uninstrumented code
+static bool roi_only_instrumentation(void){
+	return instrument_roi_only.get_value() || alternate_runs.get_value();
+}
+
+// Drops every fragment from the code cache, so that blocks get rebuilt (and instrumented or not)
+// according to the current state the next time they execute.
+// This is called from drwrap callbacks, i.e. from a clean call, where the unlink flavour is allowed:
+// the fragment currently executing completes and is then deleted.
+static void flush_code_cache(void){
+#ifdef VALIDATE
+	dr_printf("> Flushing the code cache\n");
+#endif
+	dr_unlink_flush_region(NULL, ~((ptr_uint_t)0));
+}
+
+static void open_roi_instrumentation(ThreadData *data){
+	if(!roi_only_instrumentation())
+		return;
+	// Whatever has been buffered outside of the ROI does not belong to it
+	if(!inline_count.get_value())
+		data->clean_buffer();
+	if(dr_atomic_add32_return_sum(&open_rois, 1) == 1)
+		flush_code_cache();
+}
+
+static void close_roi_instrumentation(ThreadData *data){
+	if(!roi_only_instrumentation())
+		return;
+	// Blocks outside the ROI won't perform any clean call: drain what's left in the buffer now.
+	if(!inline_count.get_value())
+		data->save_bytes();
+	if(dr_atomic_add32_return_sum(&open_rois, -1) == 0)
+		flush_code_cache();
+}
+
+// --skip_calls/--up_to_call window. ROI invocations are numbered process wide: roi_calls counts the detected
+// ones, while roi_*_detected only count the recorded ones.
+static volatile int roi_calls = 0;
+static volatile int window_calls_done = 0;
+// The window is over: no more ROIs nor instrumentation
+static volatile bool detached = false;
+
+// Wrapped ROI delimiters, to be unwrapped when detaching
+typedef struct{
+	app_pc pc;
+	void (*f_pre)(void* wrapcxt, OUT void **user_data);
+	void (*f_post)(void* wrapcxt, OUT void *user_data);
+} wrapped_function_t;
+static std::vector<wrapped_function_t> wrapped_functions;
+static void *wrap_lock;
+
+static bool call_window_enabled(void){
+	return skip_calls.get_value() > 0 || up_to_call.get_value() > 0;
+}
+
+// Whether the given invocation (starting from 1) falls within the window
+static bool in_call_window(int call){
+	if(call <= (int)skip_calls.get_value())
+		return false;
+	return up_to_call.get_value() <= 0 || call <= (int)skip_calls.get_value() + up_to_call.get_value();
+}
+
+// Stops wrapping the delimiters once the window is over. It runs from the delimiter called next,
+// not from the callback of the last window invocation: unwrapping there would lose the end of
+// the invocations other threads have open.
+static void detach_call_window(void){
+	dr_mutex_lock(wrap_lock);
+	if(!wrapped_functions.empty()){
+#ifdef VALIDATE
+		dr_printf("> Last traced call done: detaching\n");
+#endif
+		for(auto &f : wrapped_functions){
+			if(!drwrap_unwrap(f.pc, f.f_pre, f.f_post))
+				DR_ASSERT_MSG(false, "> ERROR: Couldn't unwrap a ROI delimiter\n");
+		}
+		wrapped_functions.clear();
+	}
+	dr_mutex_unlock(wrap_lock);
+}
+
+// A ROI invocation starts: numbers it and tells whether it falls within the window.
+// Only the starts and ends of the window invocations are counted (roi_*_detected).
+static bool call_window_start(ThreadData *data){
+	if(!call_window_enabled())
+		return true;
+	if(detached){
+		detach_call_window();
+		return false;
+	}
+	data->roi_in_window = in_call_window(dr_atomic_add32_return_sum(&roi_calls, 1));
+	return data->roi_in_window;
+}
+
+// A ROI invocation ends: tells whether it was a window one. After the last of them no
+// window invocation is open anymore: the instrumented code is thrown away, blocks are then
+// built uninstrumented, and the delimiters are unwrapped at the next call.
+static bool call_window_end(ThreadData *data){
+	if(!call_window_enabled())
+		return true;
+	if(!data->roi_in_window)
+		return false;
+	data->roi_in_window = false;
+	if(up_to_call.get_value() > 0 &&
+	   dr_atomic_add32_return_sum(&window_calls_done, 1) == up_to_call.get_value()){
+		detached = true;
+		flush_code_cache();
+	}
+	return true;
+}
+
+static bool instrumentation_enabled(void){
+	if(detached)
+		return false;
+	return !roi_only_instrumentation() || open_rois > 0;
+}
+
+
 // get_label_and_assign_id retrieves the label for the given function, and appends a unique identifier representing the n_th
 // time the traced function is being executed.
 // get_label_and_assign_id is supposed to work when --trace_f <Funcion Name> is specified
-static std::string get_label_and_assign_id(void *wrapcxt, droption_t<std::string> user_defined_delimiter){
+// Calls are numbered per thread.
+static std::string get_label_and_assign_id(ThreadData *data, void *wrapcxt, droption_t<std::string> user_defined_delimiter){
 	DR_ASSERT_MSG(user_defined_delimiter.get_value() != "", "> ERROR: Function name is unspecified when using --trace_f\n");
 
 	std::string label;
-	static int id = 1;
-	static std::string last_seen_delimiter;
-	label = user_defined_delimiter.get_value() + std::to_string(id);
+	label = user_defined_delimiter.get_value() + std::to_string(data->trace_f_call_id);
 #ifdef VALIDATE
 	dr_printf("Getting Label %s\n", label.c_str());
 #endif
 	// Increment the id for the next timE
-	if(last_seen_delimiter == label){
-		id++;
+	if(data->trace_f_last_label == label){
+		data->trace_f_call_id++;
 	}
 	else
-		last_seen_delimiter = label;
+		data->trace_f_last_label = label;
 	return label;
 }
 
@@ -202,25 +523,53 @@ static void event_roi_init(void *wrapcxt, OUT void**user_data){
 #ifdef VALIDATE
 	dr_printf(">> ROI Start <<\n");
 #endif
-	roi_start_detected++;
-	in_roi = true;
-
 	ThreadData *data = reinterpret_cast<ThreadData*>(drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), tls_idx));
+	droption_t<std::string> &delimiter = trace_f.get_value() != "" ? trace_f : roi_start;
+	data->roi_sampled = call_window_start(data);
+	if(!data->roi_sampled)
+		return;
+	data->roi_start_detected++;
+	if(sampling_enabled()){
+		// Invocations which are not sampled are not recorded, as if out of any ROI
+		data->roi_sampled = data->sample_invocation(get_label(wrapcxt, delimiter),
+				time_run.get_value() ? 1 : sample_rate.get_value(), sample_random.get_value());
+		if(!data->roi_sampled)
+			return;
+	}
+	if(alternate_runs.get_value()){
+		// Timed invocations run uninstrumented code: no ROI as far as counting is concerned.
+		// The ones rebuilding that code after a counted invocation are left out altogether.
+		alternate_phase_t phase = data->alternate_invocation(get_label(wrapcxt, delimiter));
+		data->roi_timed = phase == ALTERNATE_TIMED;
+		data->roi_sampled = phase != ALTERNATE_WARMUP;
+		if(!data->roi_sampled)
+			return;
+	}
+	if(!data->roi_timed){
+		data->in_roi = true;
+		if(inline_count.get_value())
+			data->start_counters();
+		open_roi_instrumentation(data);
+	}
 	// Initialize current Point
-	if(calls_as_separate_roi.get_value() == false && trace_f.get_value() != ""){
+	if(per_label_points()){
+		data->new_point(get_label(wrapcxt, delimiter),
+				get_line_n(wrapcxt, delimiter),
+				get_src_file_name(wrapcxt, delimiter));
+	}
+	else if(calls_as_separate_roi.get_value() == false && trace_f.get_value() != ""){
 		//Since all function complete executions are merged into a single ROI,
 		//We initialize a point only the very first time.
-		static bool new_point_only_once=false;
-		if(new_point_only_once == false){
+		if(data->trace_f_point_created == false){
 			data->new_point(get_label(wrapcxt, trace_f),
 					get_line_n(wrapcxt, trace_f),
 					get_src_file_name(wrapcxt, trace_f));
-			new_point_only_once = true;
+			data->trace_f_point_created = true;
 		}
 	
 	}
 	else if(calls_as_separate_roi.get_value() == true){
-		data->new_point(get_label_and_assign_id(wrapcxt, trace_f),
+		data->new_point(get_label_and_assign_id(data, wrapcxt, trace_f),
 				get_line_n(wrapcxt, trace_f),
 				get_src_file_name(wrapcxt, trace_f));
 
@@ -230,8 +579,8 @@ static void event_roi_init(void *wrapcxt, OUT void**user_data){
 				get_line_n(wrapcxt, roi_start),
 				get_src_file_name(wrapcxt, roi_start));
 	}
-	if(time_run.get_value()){
-		data->set_time_start(get_time());
+	if(time_run.get_value() || data->roi_timed){
+		data->set_time_start(timer_wall_time(), timer_thread_cpu_time());
 	}
 }
 
@@ -243,29 +592,41 @@ static void symbol_roi_end(void *wrapcxt, OUT void *user_data){
 	dr_printf(">> Symbol ROI End <<\n");
 #endif
 
-	in_roi = false;
-	roi_end_detected++;
-
 	ThreadData *data = reinterpret_cast<ThreadData*>(drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), tls_idx));
-	if(time_run.get_value()){
-		data->set_time_end(get_time());
+	if(!call_window_end(data))
+		return;
+	data->roi_end_detected++;
+	if(!data->roi_sampled)
+		return;
+	if(time_run.get_value() || data->roi_timed){
+		data->set_time_end(timer_wall_time(), timer_thread_cpu_time());
 #ifdef VALIDATE
 		dr_printf(">> Gathering timing information STOP <<\n");
 #endif
 	}
 
-	if(trace_f.get_value() == ""){
+	if(!data->roi_timed){
+		data->in_roi = false;
+		close_roi_instrumentation(data);
+		if(inline_count.get_value())
+			data->stop_counters();
+	}
+
+	if(per_label_points()){
+		droption_t<std::string> &delimiter = trace_f.get_value() != "" ? trace_f : roi_end;
+		data->save_sample(get_line_n(wrapcxt, delimiter), get_src_file_name(wrapcxt, delimiter));
+	}
+	else if(trace_f.get_value() == ""){
 		data->save_point(get_label(wrapcxt,roi_end),
 				get_line_n(wrapcxt,roi_end),
 				get_src_file_name(wrapcxt,roi_end));
 
 	}
 	else if(calls_as_separate_roi.get_value() == true){
-		data->save_point(get_label_and_assign_id(wrapcxt, trace_f),
+		data->save_point(get_label_and_assign_id(data, wrapcxt, trace_f),
 				get_line_n(wrapcxt, trace_f),
 				get_src_file_name(wrapcxt, trace_f));
 	}
-
 }
 
 
@@ -277,18 +638,31 @@ static void event_roi_end(void *wrapcxt, OUT void **user_data){
 	dr_printf(">> ROI End <<\n");
 #endif
 
-	in_roi = false;
-	roi_end_detected++;
-
 	ThreadData *data = reinterpret_cast<ThreadData*>(drmgr_get_tls_field(drwrap_get_drcontext(wrapcxt), tls_idx));
-	if(time_run.get_value()){
-		data->set_time_end(get_time());
+	if(!call_window_end(data))
+		return;
+	data->roi_end_detected++;
+	if(!data->roi_sampled)
+		return;
+	if(time_run.get_value() || data->roi_timed){
+		data->set_time_end(timer_wall_time(), timer_thread_cpu_time());
 #ifdef VALIDATE
 		dr_printf(">> Gathering timing information STOP <<\n");
 #endif
 	}
 
-	if(trace_f.get_value() == ""){
+	if(!data->roi_timed){
+		data->in_roi = false;
+		close_roi_instrumentation(data);
+		if(inline_count.get_value())
+			data->stop_counters();
+	}
+
+	if(per_label_points()){
+		droption_t<std::string> &delimiter = trace_f.get_value() != "" ? trace_f : roi_end;
+		data->save_sample(get_line_n(wrapcxt, delimiter), get_src_file_name(wrapcxt, delimiter));
+	}
+	else if(trace_f.get_value() == ""){
 		// Just take the label as the starting function name
 		data->save_point(get_label(wrapcxt,roi_start),
 				get_line_n(wrapcxt,roi_end),
@@ -300,7 +674,6 @@ static void event_roi_end(void *wrapcxt, OUT void **user_data){
 				get_line_n(wrapcxt, trace_f),
 				get_src_file_name(wrapcxt, trace_f));
 	}
-
 }
 
 
@@ -311,11 +684,10 @@ file_t debug_file;
 file_t disassemble_file;
 #endif
 file_t out_file;
+// roofline_time.xml, with --alternate_runs
+static file_t time_out_file;
 
 
-#define TLS_SLOT(tls_base, enum_val) (void **)((byte *)(tls_base) + tls_offs + (enum_val))
-#define BUF_PTR(tls_base) *(mem_ref_t **)TLS_SLOT(tls_base, MEMTRACE_TLS_OFFS_BUF_PTR)
-
 #define MINSERT instrlist_meta_preinsert
 
 
@@ -327,9 +699,14 @@ static void clean_call(int fp_instr_count){
     // Make the memory reference buffer empty no matter what.
     // IF we are in ROI, save the partial result.
 
+    void *drcontext = dr_get_current_drcontext();
+    ThreadData *data = reinterpret_cast<ThreadData*>(drmgr_get_tls_field(drcontext, tls_idx));
+    //TODO: wrap it in a validate.
+    DR_ASSERT_MSG(data != NULL, ">>> DynamoRIO Client ERROR: Failed initialization for per thread class\n");
+
 #ifdef VALIDATE_VERBOSE
 
-    if(in_roi){
+    if(data->in_roi){
 	dr_printf("Clean call on @ " PFX "\n", address);
     }
 
@@ -343,13 +720,8 @@ static void clean_call(int fp_instr_count){
 
 #endif
 
-    void *drcontext = dr_get_current_drcontext();
-    ThreadData *data = reinterpret_cast<ThreadData*>(drmgr_get_tls_field(drcontext, tls_idx));
-    //TODO: wrap it in a validate.
-    DR_ASSERT_MSG(data != NULL, ">>> DynamoRIO Client ERROR: Failed initialization for per thread class\n");
-
     // If in ROI, update the floating point value
-    if(in_roi){
+    if(data->in_roi){
 	    data->save_floating_points(fp_instr_count);
 	    data->save_bytes();
     }
@@ -359,22 +731,50 @@ static void clean_call(int fp_instr_count){
     return;
 }
 
+// Block flags passed to clean_call_block
+#define BLOCK_FUNCTION_ENTRY 0x1 // The block starts at its function entry point
+
+// Clean call of --call_graph, --line_heatmap and --detect_loops: also tells which block is being executed,
+// its function, its loop block and its last instruction
+static void clean_call_block(int fp_instr_count, int instructions, app_pc tag, int func_id, int loop_block, int flags,
+		app_pc last_pc){
+    void *drcontext = dr_get_current_drcontext();
+    ThreadData *data = reinterpret_cast<ThreadData*>(drmgr_get_tls_field(drcontext, tls_idx));
+    DR_ASSERT_MSG(data != NULL, ">>> DynamoRIO Client ERROR: Failed initialization for per thread class\n");
+
+    bool is_entry = (flags & BLOCK_FUNCTION_ENTRY) != 0;
+    if(data->in_roi)
+	    data->save_block(fp_instr_count, func_id, is_entry, instructions, tag, loop_block, last_pc);
+    else
+	    data->follow_block(fp_instr_count, func_id, is_entry, instructions, tag, loop_block, last_pc);
+}
+
+// The memory reference buffer filled up before the next clean call could drain it:
+// drx_buf caught the store faulting on its guard page. Drain it here, drx_buf then
+// resets the buffer pointer to its base.
+static void
+buffer_full(void *drcontext, void *buf_base, size_t size)
+{
+    ThreadData *data = reinterpret_cast<ThreadData*>(drmgr_get_tls_field(drcontext, tls_idx));
+#ifdef VALIDATE
+    dr_printf("> Memory reference buffer full, draining %lu entries\n", size / ThreadData::ref_stride);
+#endif
+    // Loops are profiled over the whole run
+    if(data != NULL && (data->in_roi || ThreadData::loop_detection_enabled))
+        data->save_refs((byte*)buf_base, (byte*)buf_base + size, data->in_roi);
+}
+
 static void
 insert_load_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t reg_ptr)
 {
-    dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg,
-                           tls_offs + MEMTRACE_TLS_OFFS_BUF_PTR, reg_ptr);
+    drx_buf_insert_load_buf_ptr(drcontext, mem_buf, ilist, where, reg_ptr);
 }
 
 static void
 insert_update_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
-                      reg_id_t reg_ptr, int adjust)
+                      reg_id_t reg_ptr, reg_id_t scratch, int adjust)
 {
-    MINSERT(
-        ilist, where,
-        XINST_CREATE_add(drcontext, opnd_create_reg(reg_ptr), OPND_CREATE_INT16(adjust)));
-    dr_insert_write_raw_tls(drcontext, ilist, where, tls_seg,
-                            tls_offs + MEMTRACE_TLS_OFFS_BUF_PTR, reg_ptr);
+    drx_buf_insert_update_buf_ptr(drcontext, mem_buf, ilist, where, reg_ptr, scratch, (ushort)adjust);
 }
 
 static void
@@ -405,7 +805,6 @@ insert_save_size(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t b
                                       opnd_create_reg(scratch)));
 }
 
-#ifdef VALIDATE_VERBOSE
 static void
 insert_save_pc(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t base,
                reg_id_t scratch, app_pc pc)
@@ -414,54 +813,246 @@ insert_save_pc(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t bas
                                      ilist, where, NULL, NULL);
     MINSERT(ilist, where,
             XINST_CREATE_store(drcontext,
-                               OPND_CREATE_MEMPTR(base, offsetof(mem_ref_t, addr)),
+                               OPND_CREATE_MEMPTR(base, offsetof(mem_ref_addr_t, pc)),
                                opnd_create_reg(scratch)));
 }
-#endif
+
+static void
+insert_save_addr(void *drcontext, instrlist_t *ilist, instr_t *where, opnd_t ref,
+                 reg_id_t base, reg_id_t reg_addr, reg_id_t scratch)
+{
+    /* we use reg_addr to obtain the address, scratch is clobbered while computing it */
+    bool ok = drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg_addr, scratch);
+    DR_ASSERT(ok);
+    MINSERT(ilist, where,
+            XINST_CREATE_store(drcontext,
+                               OPND_CREATE_MEMPTR(base, offsetof(mem_ref_addr_t, addr)),
+                               opnd_create_reg(reg_addr)));
+}
+
+
+/* Instrumentation policies.
+ * What gets recorded, and how, is decided only once in dr_client_main, which registers
+ * the instantiation of event_app_instruction<Direction, Recording> matching the options.
+ * Each instantiation emits only the inline code it needs: no option is looked up
+ * while blocks are built. The timing-only policy is not to instrument blocks at all.
+ */
+
+// Direction policies: which memory instructions are recorded, and as what kind of access:
+// 0 --> Instruction will READ memory
+// 1 --> Instruction will WRITE memory
+// fixed_kind is the kind of all the recorded entries, -1 if each entry carries its own.
+struct read_only_policy {
+    static const int fixed_kind = 0;
+    static bool records(instr_t *instr){ return instr_reads_memory(instr); }
+    static ushort kind(instr_t *instr){ return 0; }
+};
+
+struct write_only_policy {
+    static const int fixed_kind = 1;
+    static bool records(instr_t *instr){ return instr_writes_memory(instr); }
+    static ushort kind(instr_t *instr){ return 1; }
+};
+
+// An instruction both reading and writing memory is recorded as a read.
+struct read_write_policy {
+    static const int fixed_kind = -1;
+    static bool records(instr_t *instr){ return instr_reads_memory(instr) || instr_writes_memory(instr); }
+    static ushort kind(instr_t *instr){ return instr_reads_memory(instr) ? 0 : 1; }
+};
+
+// Recording policies: how the recorded accesses reach the current point.
+// Block totals added to the per-thread TLS counters (--inline_count), with their stack bytes (--stack_bytes)
+template <bool with_stack_bytes>
+struct inline_policy {
+    static const bool inline_counters = true;
+    static const bool stack_bytes = with_stack_bytes;
+    static const bool addresses = false;
+    static const bool call_graph = false;
+    static const bool line_heatmap = false;
+    static const bool loops = false;
+    typedef mem_ref_t entry_t;
+};
+
+// Entries in the memory reference buffer, drained by a clean call per block.
+// The address-carrying flavour also records the accessed address and the instruction pc.
+// With call graph attribution, the line heatmap and loop detection, the clean call also tells which block it is.
+// The line heatmap needs the instruction pcs of the address-carrying entries, the other analyses are covered by
+// addresses_needed().
+// Stack accesses are tagged in the type of the address-carrying entries, at no runtime cost.
+template <bool with_addresses, bool with_call_graph, bool with_line_heatmap, bool with_loops>
+struct buffer_policy {
+    static const bool inline_counters = false;
+    static const bool stack_bytes = false;
+    static const bool addresses = with_addresses || with_line_heatmap;
+    static const bool call_graph = with_call_graph;
+    static const bool line_heatmap = with_line_heatmap;
+    static const bool loops = with_loops;
+    typedef typename std::conditional<addresses, mem_ref_addr_t, mem_ref_t>::type entry_t;
+};
+
+
+// Whether the memory accesses of the given instruction have to be recorded.
+// Software prefetches don't move any data into registers: they are not taken into account.
+template <class Direction>
+static bool
+is_recorded_mem_instr(instr_t *instr)
+{
+    return !instr_is_prefetch(instr) && Direction::records(instr);
+}
+
+// The memory operand the recorded address refers to
+template <class Direction>
+static opnd_t
+get_recorded_mem_opnd(instr_t *instr)
+{
+    if(Direction::kind(instr) == 0){
+        for(int i = 0; i < instr_num_srcs(instr); i++){
+            if(opnd_is_memory_reference(instr_get_src(instr, i)))
+                return instr_get_src(instr, i);
+        }
+    }
+    for(int i = 0; i < instr_num_dsts(instr); i++){
+        if(opnd_is_memory_reference(instr_get_dst(instr, i)))
+            return instr_get_dst(instr, i);
+    }
+    return opnd_create_null();
+}
+
+typedef struct _bb_totals_t {
+    uint32_t fp_instr_count;
+    uint32_t bytes;
+    uint32_t read_bytes;
+    uint32_t write_bytes;
+    uint32_t instructions;
+    uint32_t stack_read_bytes;
+    uint32_t stack_write_bytes;
+} bb_totals_t;
+
+// Computes, at block build time, what a whole execution of the basic block accounts for:
+// the very same quantities the clean call gathers at runtime from the memory reference buffer.
+template <class Direction>
+static bb_totals_t
+get_bb_totals(instrlist_t *bb)
+{
+    bb_totals_t totals = {0, 0, 0, 0, 0, 0, 0};
+    for(instr_t *instr_it = instrlist_first_app(bb); instr_it != nullptr; instr_it = instr_get_next_app(instr_it)){
+        // Masked and predicated FP instructions are counted at runtime by insert_runtime_flops
+        if(!is_masked_fp_instr(instr_it))
+            totals.fp_instr_count += count_fp_instr(instr_it);
+        totals.instructions++;
+        // Bytes only known at runtime are added by insert_runtime_bytes
+        if(!is_recorded_mem_instr<Direction>(instr_it) || is_runtime_sized_mem_instr(instr_it))
+            continue;
+        uint size = instr_memory_reference_size(instr_it);
+        totals.bytes += size;
+        if(Direction::kind(instr_it) == 0)
+            totals.read_bytes += size;
+        else
+            totals.write_bytes += size;
+        // As in the recorded entries (MEM_REF_WRITES), a read-modify-write is a stack write
+        if(is_stack_opnd(get_recorded_mem_opnd<Direction>(instr_it))){
+            if(Direction::kind(instr_it) == 0 && !instr_writes_memory(instr_it))
+                totals.stack_read_bytes += size;
+            else
+                totals.stack_write_bytes += size;
+        }
+    }
+    return totals;
+}
+
+
+// The type stored in the entry of the given instruction: its kind, plus,
+// in the address-carrying entries, how it moves data through the caches and whether it addresses the stack.
+template <class Direction, class Recording>
+static ushort
+get_mem_ref_type(instr_t *instr)
+{
+    ushort type = Direction::kind(instr);
+    if(Recording::addresses){
+        if(type == 0 && instr_writes_memory(instr))
+            type |= MEM_REF_WRITES;
+        if(is_non_temporal_store(instr))
+            type |= MEM_REF_NON_TEMPORAL;
+        if(is_stack_opnd(get_recorded_mem_opnd<Direction>(instr))){
+            type |= MEM_REF_STACK;
+            if(is_spill_candidate(instr))
+                type |= MEM_REF_SPILL;
+        }
+    }
+    return type;
+}
 
 
 /* insert inline code to add an instruction entry into the buffer */
+template <class Direction, class Recording>
 static void
 instrument_instr(void *drcontext, instrlist_t *ilist, instr_t *where)
 {
-    /* We need two scratch registers */
-    reg_id_t reg_ptr, reg_tmp;
+    /* We need two scratch registers, plus one for the address */
+    reg_id_t reg_ptr, reg_tmp, reg_addr = DR_REG_NULL;
     /* we don't want to predicate this, because an instruction fetch always occurs */
     instrlist_set_auto_predicate(ilist, DR_PRED_NONE);
     if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_ptr) !=
             DRREG_SUCCESS ||
         drreg_reserve_register(drcontext, ilist, where, NULL, &reg_tmp) !=
-            DRREG_SUCCESS) {
+            DRREG_SUCCESS ||
+        (Recording::addresses &&
+         drreg_reserve_register(drcontext, ilist, where, NULL, &reg_addr) != DRREG_SUCCESS)) {
         DR_ASSERT(false); /* cannot recover */
         return;
     }
     insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
     insert_save_size(drcontext, ilist, where, reg_ptr, reg_tmp, (ushort)instr_memory_reference_size(where));
-    //Save type for 
-    // 0 --> Instruction will READ memory
-    // 1 --> Instruction will WRITE memory
-    ushort instr_kind;
-    if(instr_reads_memory(where))
-        instr_kind = 0;
-    else if(instr_writes_memory(where))
-        instr_kind = 1;
-    insert_save_type(drcontext, ilist, where, reg_ptr, reg_tmp, instr_kind);
-#ifdef VALIDATE_VERBOSE
-    insert_save_pc(drcontext, ilist, where, reg_ptr, reg_tmp, instr_get_app_pc(where));
-#endif
-    insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, sizeof(mem_ref_t));
+    if (Direction::fixed_kind < 0 || Recording::addresses)
+        insert_save_type(drcontext, ilist, where, reg_ptr, reg_tmp, get_mem_ref_type<Direction, Recording>(where));
+    if (Recording::addresses) {
+        insert_save_addr(drcontext, ilist, where, get_recorded_mem_opnd<Direction>(where),
+                         reg_ptr, reg_addr, reg_tmp);
+        insert_save_pc(drcontext, ilist, where, reg_ptr, reg_tmp, instr_get_app_pc(where));
+    }
+    insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, reg_tmp, sizeof(typename Recording::entry_t));
     /* Restore scratch registers */
     if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr) != DRREG_SUCCESS ||
-        drreg_unreserve_register(drcontext, ilist, where, reg_tmp) != DRREG_SUCCESS)
+        drreg_unreserve_register(drcontext, ilist, where, reg_tmp) != DRREG_SUCCESS ||
+        (Recording::addresses &&
+         drreg_unreserve_register(drcontext, ilist, where, reg_addr) != DRREG_SUCCESS))
         DR_ASSERT(false);
     instrlist_set_auto_predicate(ilist, instr_get_predicate(where));
 }
 
 
 
+// Decides, once per basic block, whether it has to be instrumented.
+static dr_emit_flags_t
+event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+                  bool translating, void **user_data)
+{
+    *user_data = (void *)(ptr_uint_t)instrumentation_enabled();
+    // With --instrument_roi_only (or --up_to_call) the same block may be instrumented or not depending on when
+    // it is built: store translations so that a later state restore does not depend on it.
+    return roi_only_instrumentation() || up_to_call.get_value() > 0 ? DR_EMIT_STORE_TRANSLATIONS : DR_EMIT_DEFAULT;
+}
+
+
+// --call_graph, --line_heatmap and --detect_loops attribute each block execution from a callout at its start.
+// A trace stitches blocks (across calls, returns and loop back edges) under the tag of its head, with a single
+// callout for all of them: traces are ended right after their head block, so that each fragment is a block of its own.
+static bool per_block_callouts(void){
+	return call_graph.get_value() || line_heatmap.get_value() || detect_loops.get_value();
+}
+
+static dr_custom_trace_action_t
+event_end_trace(void *drcontext, void *tag, void *next_tag)
+{
+    return CUSTOM_TRACE_END_NOW;
+}
+
+
 /* For each memory reference app instr, we insert inline code to fill the buffer
  * with an instruction entry and memory reference entries.
  */
+template <class Direction, class Recording>
 static dr_emit_flags_t
 event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *instr,
                       bool for_trace, bool translating, void *user_data)
@@ -469,61 +1060,195 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst
 
     drmgr_disable_auto_predication(drcontext, bb);
 
+    // Outside of any ROI (--instrument_roi_only), leave the block untouched
+    if(user_data == NULL || !instr_is_app(instr))
+        return DR_EMIT_DEFAULT;
+
+    // Rep string operations, gathers, scatters, masked and predicated loads and stores:
+    // the accessed bytes are computed at runtime
+    // and accumulated in the TLS counters, whatever the recording policy.
+    bool recorded = is_recorded_mem_instr<Direction>(instr);
+    if(recorded && is_runtime_sized_mem_instr(instr)){
+	    insert_runtime_bytes(drcontext, bb, instr,
+			    Direction::kind(instr) == 0 ? MEMTRACE_TLS_OFFS_READ_BYTES : MEMTRACE_TLS_OFFS_WRITE_BYTES);
+	    recorded = false;
+    }
+    // Likewise for the FP operations of the masked and predicated instructions: their active lanes
+    insert_runtime_flops(drcontext, bb, instr);
+
     // Instrument the target application
-    if(instr_is_app(instr)){
-	    if(read_bytes_only.get_value() == true){
-		    if(instr_reads_memory(instr))
-			    instrument_instr(drcontext, bb, instr);
-	    }
-	    else if(write_bytes_only.get_value() == true){
-		    if(instr_writes_memory(instr))
-			    instrument_instr(drcontext, bb, instr);
-	    }
-	    else if(instr_reads_memory(instr) || instr_writes_memory(instr)){
-		    /* insert code to add an entry for app instruction */
-		    instrument_instr(drcontext, bb, instr);
+    if(Recording::inline_counters){
+	    // The whole basic block is accounted for at once, from its first instruction:
+	    // no memory reference buffer and no clean call.
+	    if(drmgr_is_first_instr(drcontext, instr) &&
+	       IF_AARCHXX_ELSE(!instr_is_exclusive_store(instr), true)){
+		    bb_totals_t totals = get_bb_totals<Direction>(bb);
+		    counter_update_t updates[] = {
+			    {MEMTRACE_TLS_OFFS_FP_COUNT, totals.fp_instr_count},
+			    {MEMTRACE_TLS_OFFS_BYTES, totals.bytes},
+			    {MEMTRACE_TLS_OFFS_READ_BYTES, totals.read_bytes},
+			    {MEMTRACE_TLS_OFFS_WRITE_BYTES, totals.write_bytes},
+			    // Zero valued updates are skipped
+			    {MEMTRACE_TLS_OFFS_STACK_READ_BYTES, Recording::stack_bytes ? totals.stack_read_bytes : 0},
+			    {MEMTRACE_TLS_OFFS_STACK_WRITE_BYTES, Recording::stack_bytes ? totals.stack_write_bytes : 0}
+		    };
+#ifdef VALIDATE_VERBOSE
+		    dr_fprintf(debug_file, "Basic block @" PFX ": %u FP Instructions, %u Bytes\n",
+				    tag, totals.fp_instr_count, totals.bytes);
+#endif
+		    insert_counters_update(drcontext, bb, instr, updates, sizeof(updates) / sizeof(updates[0]));
 	    }
+	    return DR_EMIT_DEFAULT;
+    }
+
+    if(recorded){
+	    /* insert code to add an entry for app instruction */
+	    instrument_instr<Direction, Recording>(drcontext, bb, instr);
+    }
 
 
-	    // We insturment a clean call only for the very first instruction within the basic block.
-	    // In a super optimized version, you may want to try some approach to avoid the clean call.
-	    if(drmgr_is_first_instr(drcontext, instr)){
+    // We insturment a clean call only for the very first instruction within the basic block.
+    // With --inline_count, the clean call is avoided altogether.
+    if(drmgr_is_first_instr(drcontext, instr)){
 
-		    // Compute the number of floating point instructions in this basic block
-		    uint32_t fp_instr_count = 0;
-		    instr_t *instr_it;
-		    for(instr_it = instrlist_first_app(bb); instr_it != nullptr; instr_it = instr_get_next_app(instr_it)){
-			    fp_instr_count = fp_instr_count + count_fp_instr(instr_it);
-		    }
+	    // Compute the number of floating point instructions in this basic block
+	    uint32_t fp_instr_count = get_bb_totals<Direction>(bb).fp_instr_count;
 
 #ifdef VALIDATE_VERBOSE
-		    if (fp_instr_count > 0){
-			    dr_fprintf(debug_file, "Number of FP Instructions detected: %d\n", fp_instr_count);
-		    }
-		    uint64_t address = reinterpret_cast<uint64_t>(tag);
+	    if (fp_instr_count > 0){
+		    dr_fprintf(debug_file, "Number of FP Instructions detected: %d\n", fp_instr_count);
+	    }
+	    uint64_t address = reinterpret_cast<uint64_t>(tag);
 #endif
-		    /* Insert code to call clean_call for processing the buffer
-		     * In this way what you get is that the instrumented basic block will perform a clean call
-		     * at runtime, whose argument is its number of floating point instructions
-		     * that are going to be executed
-		     */
-		    // For the time being I want to be conservative and only take into account in_roi at runtime.
-		    if (IF_AARCHXX_ELSE(!instr_is_exclusive_store(instr), true))
+	    /* Insert code to call clean_call for processing the buffer
+	     * In this way what you get is that the instrumented basic block will perform a clean call
+	     * at runtime, whose argument is its number of floating point instructions
+	     * that are going to be executed
+	     */
+	    // For the time being I want to be conservative and only take into account in_roi at runtime.
+	    if (Recording::call_graph || Recording::line_heatmap || Recording::loops){
+		    if (IF_AARCHXX_ELSE(!instr_is_exclusive_store(instr), true)){
+			    bool is_entry = false;
+			    int func_id = -1;
+			    int loop_block = NO_LOOP_BLOCK;
+			    app_pc start_pc = dr_fragment_app_pc(tag);
+			    if (Recording::call_graph)
+				    func_id = call_graph_function_id(start_pc, &is_entry);
+			    if (Recording::loops)
+				    loop_block = loop_detector_register_block(start_pc, bb);
+			    if (Recording::line_heatmap){
+				    std::vector<heatmap_instr_t> instrs;
+				    // The active lanes of masked FP instructions are only known at runtime: they are not attributed to lines
+				    for(instr_t *instr_it = instrlist_first_app(bb); instr_it != nullptr; instr_it = instr_get_next_app(instr_it))
+					    instrs.push_back(heatmap_instr_t{instr_get_app_pc(instr_it),
+							    is_masked_fp_instr(instr_it) ? 0 : (int)count_fp_instr(instr_it)});
+				    line_heatmap_register_block(start_pc, instrs);
+			    }
+			    int flags = is_entry ? BLOCK_FUNCTION_ENTRY : 0;
+			    app_pc last_pc = instr_get_app_pc(instrlist_last_app(bb));
+			    dr_insert_clean_call(drcontext, bb, instr, (void *)clean_call_block, false, 7,
+					    OPND_CREATE_INT32(fp_instr_count), OPND_CREATE_INT32(get_bb_totals<Direction>(bb).instructions),
+					    OPND_CREATE_INTPTR((ptr_int_t)start_pc), OPND_CREATE_INT32(func_id),
+					    OPND_CREATE_INT32(loop_block), OPND_CREATE_INT32(flags), OPND_CREATE_INTPTR((ptr_int_t)last_pc));
+		    }
+	    }
+	    else if (IF_AARCHXX_ELSE(!instr_is_exclusive_store(instr), true))
 #ifdef VALIDATE_VERBOSE
-			    dr_insert_clean_call(drcontext, bb, instr, (void *)clean_call, false, 2, OPND_CREATE_INT32(fp_instr_count), OPND_CREATE_INT64(address));
+		    dr_insert_clean_call(drcontext, bb, instr, (void *)clean_call, false, 2, OPND_CREATE_INT32(fp_instr_count), OPND_CREATE_INT64(address));
 #else
-			    dr_insert_clean_call(drcontext, bb, instr, (void *)clean_call, false, 1, OPND_CREATE_INT32(fp_instr_count));
+		    dr_insert_clean_call(drcontext, bb, instr, (void *)clean_call, false, 1, OPND_CREATE_INT32(fp_instr_count));
 #endif
-	    }
+    }
 
 #ifdef VALIDATE_VERBOSE
-		    instrlist_disassemble(drcontext, (app_pc)tag, bb, disassemble_file);
-		    dr_flush_file(disassemble_file);
+    instrlist_disassemble(drcontext, (app_pc)tag, bb, disassemble_file);
+    dr_flush_file(disassemble_file);
 #endif
 
+    return DR_EMIT_DEFAULT;
+}
 
+
+// Sets up the memory reference buffer layout of the given policies and returns their instrumentation
+template <class Direction, class Recording>
+static drmgr_insertion_cb_t
+use_policy(void)
+{
+    ThreadData::ref_fixed_kind = Direction::fixed_kind;
+    ThreadData::ref_stride = sizeof(typename Recording::entry_t);
+    return event_app_instruction<Direction, Recording>;
+}
+
+template <class Recording>
+static drmgr_insertion_cb_t
+select_direction_policy(void)
+{
+    if(read_bytes_only.get_value())
+        return use_policy<read_only_policy, Recording>();
+    if(write_bytes_only.get_value())
+        return use_policy<write_only_policy, Recording>();
+    return use_policy<read_write_policy, Recording>();
+}
+
+// Whether the memory reference entries have to carry the accessed address and the instruction pc
+static bool
+addresses_needed(void)
+{
+#ifdef VALIDATE_VERBOSE
+    return true;
+#else
+    return cache_sim.get_value() || footprint.get_value() || reuse_distance.get_value() || false_sharing.get_value() ||
+           access_patterns.get_value() || alignment.get_value() || allocations.get_value() || stack_bytes.get_value();
+#endif
+}
+
+// Turns the buffer_policy flags, known at runtime, into its template arguments: one at a time.
+template <int remaining, bool... fixed>
+struct buffer_policy_selector {
+    static drmgr_insertion_cb_t select(const bool *flags){
+        if(flags[0])
+            return buffer_policy_selector<remaining - 1, fixed..., true>::select(flags + 1);
+        return buffer_policy_selector<remaining - 1, fixed..., false>::select(flags + 1);
     }
-    return DR_EMIT_DEFAULT;
+};
+
+template <bool... fixed>
+struct buffer_policy_selector<0, fixed...> {
+    static drmgr_insertion_cb_t select(const bool *flags){
+        return select_direction_policy<buffer_policy<fixed...>>();
+    }
+};
+
+// Picks the instrumentation policy matching the given options, NULL for the timing-only policy.
+static drmgr_insertion_cb_t
+select_instrumentation_policy(void)
+{
+    if(time_run.get_value())
+        return NULL;
+    // Inline counting splits the stack bytes as well, from the block totals
+    ThreadData::stack_bytes_enabled = stack_bytes.get_value();
+    Point::stack_bytes_enabled = stack_bytes.get_value();
+    if(inline_count.get_value())
+        return stack_bytes.get_value() ? select_direction_policy<inline_policy<true>>()
+                                       : select_direction_policy<inline_policy<false>>();
+    ThreadData::call_graph_enabled = call_graph.get_value();
+    ThreadData::line_heatmap_enabled = line_heatmap.get_value();
+    ThreadData::loop_detection_enabled = detect_loops.get_value();
+    ThreadData::cache_sim_enabled = cache_sim.get_value();
+    Point::cache_traffic_enabled = cache_sim.get_value();
+    ThreadData::footprint_enabled = footprint.get_value();
+    Point::footprint_enabled = footprint.get_value();
+    ThreadData::reuse_distance_enabled = reuse_distance.get_value();
+    Point::reuse_distance_enabled = reuse_distance.get_value();
+    ThreadData::false_sharing_enabled = false_sharing.get_value();
+    ThreadData::access_patterns_enabled = access_patterns.get_value();
+    Point::access_patterns_enabled = access_patterns.get_value();
+    ThreadData::alignment_enabled = alignment.get_value();
+    Point::alignment_enabled = alignment.get_value();
+    ThreadData::allocations_enabled = allocations.get_value();
+    Point::allocations_enabled = allocations.get_value();
+    const bool flags[] = {addresses_needed(), call_graph.get_value(), line_heatmap.get_value(), detect_loops.get_value()};
+    return buffer_policy_selector<4>::select(flags);
 }
 
 
@@ -539,9 +1264,15 @@ void trace_symbol(std::vector<wrap_callback_t> symbols, const module_data_t *mod
 
 		if(symres == DRSYM_SUCCESS){
 			app_pc startup_wrap = modoffs + mod->start;
-			dr_printf("<wrapping %s @" PFX "\n", it->f_name.c_str(), startup_wrap);
-			wrap_result = drwrap_wrap(startup_wrap, it->f_pre, it->f_post);
-			DR_ASSERT_MSG(wrap_result, ">DR Roofline Client ERROR: Couldn't use specified function as a ROI delimiter\n");
+			dr_mutex_lock(wrap_lock);
+			// Past the --up_to_call window, modules loaded later are left alone
+			if(!detached){
+				dr_printf("<wrapping %s @" PFX "\n", it->f_name.c_str(), startup_wrap);
+				wrap_result = drwrap_wrap(startup_wrap, it->f_pre, it->f_post);
+				DR_ASSERT_MSG(wrap_result, ">DR Roofline Client ERROR: Couldn't use specified function as a ROI delimiter\n");
+				wrapped_functions.push_back(wrapped_function_t{startup_wrap, it->f_pre, it->f_post});
+			}
+			dr_mutex_unlock(wrap_lock);
 		}
 	}
 	return;
@@ -582,6 +1313,9 @@ static void module_load_event(void *drcontext, const module_data_t *mod, bool lo
 
 		trace_symbol(start_stop_roi_f, mod);
 	}
+
+	if(allocations.get_value() && !time_run.get_value())
+		allocations_wrap(mod);
 }
 
 
@@ -589,25 +1323,10 @@ static void module_load_event(void *drcontext, const module_data_t *mod, bool lo
 
 
 
-/* We transform string loops into regular loops so we can more easily
- * monitor every memory reference they make.
- */
-static dr_emit_flags_t
-event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
-                 bool translating)
-{
-    if (!drutil_expand_rep_string(drcontext, bb)) {
-        DR_ASSERT(false);
-    }
-    return DR_EMIT_DEFAULT;
-}
-
 static void
 event_thread_init(void *drcontext)
 {
-    ThreadData *data = reinterpret_cast<ThreadData*>(dr_thread_alloc(drcontext, sizeof(data)));
-    data = new ThreadData{dr_get_thread_id(drcontext)};
-    //TODO: Remember to deallocate this.
+    ThreadData *data = new ThreadData{drcontext, dr_get_thread_id(drcontext)};
     DR_ASSERT_MSG(data != NULL, ">>> DynamoRIO Client ERROR: Failed initialization for per thread class\n");
     //TODO: Andrea Is it ok to have vvv here?
     drmgr_set_tls_field(drcontext, tls_idx, data);
@@ -620,29 +1339,42 @@ event_thread_exit(void *drcontext){
 
     // If we have been tracing a multiple functions executions as a single ROI,
     // not it is the time to save this a single point.
-    if(calls_as_separate_roi.get_value() == false && trace_f.get_value() != ""){
+    if(calls_as_separate_roi.get_value() == false && trace_f.get_value() != "" && data->trace_f_point_created){
 	    data->save_point(trace_f.get_value(), 0, "");
     }
-    //TODO: There should be a post execution function that iterates over all the dead thread data structures.
-    //TODO: The assumption, for now, is that you have one thread only.
-    dr_fprintf(out_file, "<?xml version=\"1.0\"?>\n");
-    dr_fprintf(out_file, "<roofline>\n");
-    data->save_to_file(out_file);
-    dr_fprintf(out_file, "</roofline>\n");
+    if(per_label_points())
+	    data->save_samples();
+    if(ThreadData::loop_detection_enabled)
+	    data->loops.merge_into_totals();
+    // Hand over the gathered points: they are written, merged with the other threads' ones, at process exit.
+    dr_mutex_lock(exited_threads_lock);
+    exited_threads.push_back(thread_points_t{data->tid, std::move(data->point_list)});
+    if(alternate_runs.get_value())
+	    exited_time_threads.push_back(thread_points_t{data->tid, std::move(data->time_point_list)});
+    roi_start_detected += data->roi_start_detected;
+    roi_end_detected += data->roi_end_detected;
+    dr_mutex_unlock(exited_threads_lock);
 
 #ifdef VALIDATE
     dr_printf("> Deallocating Thread Data\n");
 #endif
-    // TODO: Properly deallocate everything.
-    //Deallocate the pointer which we have deallocated upon thread initialization
-    dr_raw_mem_free(data->buf_base, MEM_BUF_SIZE);
+    // The memory reference buffer is deallocated by drx_buf itself.
     delete data;
-    dr_thread_free(drcontext, data, sizeof(data));
 #ifdef VALIDATE
     dr_printf("> Deallocated Thread Data\n");
 #endif
 }
 
+// Reports gathered for the whole process rather than per thread, written after the points
+static void
+dump_process_reports(file_t out_file, bool timing)
+{
+    if(detect_loops.get_value())
+        loop_detector_dump(out_file, timing);
+    if(false_sharing.get_value() && !time_run.get_value())
+        false_sharing_dump(out_file, timing);
+}
+
 static void event_exit(void)
 {
     if (!dr_raw_tls_cfree(tls_offs, MEMTRACE_TLS_COUNT))
@@ -661,20 +1393,35 @@ static void event_exit(void)
 	        !drmgr_unregister_tls_field(tls_idx) ||
 	        !drmgr_unregister_module_load_event(module_load_event) ||
 	        !drmgr_unregister_thread_exit_event(event_thread_exit) ||
-		!drmgr_unregister_bb_app2app_event(event_bb_app2app) ||
-	        !drmgr_unregister_bb_insertion_event(event_app_instruction))
+	        !drmgr_unregister_bb_instrumentation_event(event_bb_analysis))
 	    DR_ASSERT_MSG(false, "ERROR: Couldn't perform event unsubscription");
+	    if(per_block_callouts() && !dr_unregister_end_trace_event(event_end_trace))
+		    DR_ASSERT_MSG(false, "ERROR: Couldn't perform event unsubscription");
     }
 
-    DR_ASSERT_MSG(roi_start_detected > 0,
+    save_to_file(out_file, exited_threads, time_run.get_value(), dump_process_reports);
+    if(alternate_runs.get_value())
+	    save_to_file(time_out_file, exited_time_threads, true, dump_process_reports);
+    dr_mutex_destroy(exited_threads_lock);
+    dr_mutex_destroy(wrap_lock);
+
+    // Every invocation skipped by --skip_calls: the ROI has been detected, just not recorded
+    bool all_calls_skipped = roi_start_detected == 0 && roi_calls > 0;
+    if(all_calls_skipped)
+	    dr_printf("> WARNING: All the %d ROI invocations have been skipped (--skip_calls %u): nothing has been recorded\n",
+			    roi_calls, skip_calls.get_value());
+    // Detected loops don't need any ROI
+    DR_ASSERT_MSG(roi_start_detected > 0 || all_calls_skipped || detect_loops.get_value(),
 		    "> ERROR: Roi Start function has not be detected. Please check that you've written the right name and that the compiler has not inlined it\n");
-    DR_ASSERT_MSG(roi_end_detected > 0 , 
+    DR_ASSERT_MSG(roi_end_detected > 0 || all_calls_skipped || detect_loops.get_value(), 
 		    "> ERROR: Roi End function has not be detected. Please check that you've written the right name and that the compiler has not inlined it\n");
     DR_ASSERT_MSG(roi_start_detected == roi_end_detected , 
 		    "> ERROR: Uneven detection for ROI Start and Stop functions\n");
 
     if(drreg_exit() != DRREG_SUCCESS)
         DR_ASSERT(false);
+    if(mem_buf != NULL)
+        drx_buf_free(mem_buf);
 
 #ifdef VALIDATE
     dr_close_file(modules_f);
@@ -682,17 +1429,29 @@ static void event_exit(void)
     dr_close_file(disassemble_file);
 #endif
     dr_close_file(out_file);
+    if(alternate_runs.get_value())
+	    dr_close_file(time_out_file);
+    // Unsubscribes its own events and TLS field: before drmgr goes away
+    if(allocations.get_value() && !time_run.get_value())
+	    allocations_exit();
     drwrap_exit();
     drutil_exit();
+    drx_exit();
     drmgr_exit();
+    call_graph_exit();
+    line_heatmap_exit();
+    if(detect_loops.get_value())
+	    loop_detector_exit();
+    if(false_sharing.get_value() && !time_run.get_value())
+	    false_sharing_exit();
     drsym_exit();
 }
 
 DR_EXPORT void
 dr_client_main(client_id_t id, int argc, const char *argv[])
 {
-    /* We need 2 reg slots beyond drreg's eflags slots => 3 slots */
-    drreg_options_t ops = { sizeof(ops), 3, false };
+    /* We need up to 3 reg slots beyond drreg's eflags slots => 4 slots */
+    drreg_options_t ops = { sizeof(ops), 4, false };
     dr_set_client_name("DynamoRIO Sample Client 'Roofline'","http://dynamorio.org/issues");
     dr_log(NULL, DR_LOG_ALL, 1, "Roofline Initializing\n");
 
@@ -710,15 +1469,18 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
 	    DR_ASSERT_MSG(roi_end.get_value() == "",  "> ERROR: Please specify either roi_start and roi_end function or trace_f\n");
     }
 
-    if (!drmgr_init() || drreg_init(&ops) != DRREG_SUCCESS || !drutil_init() || !drwrap_init())
+    if (!drmgr_init() || drreg_init(&ops) != DRREG_SUCCESS || !drutil_init() || !drwrap_init() || !drx_init())
         DR_ASSERT(false);
     drsym_init(0);
+    call_graph_init();
+    line_heatmap_init();
 
     /* register events */
     dr_register_exit_event(event_exit);
 
     if(time_run.get_value()){
 	    dr_printf("> Roofline is running for gathering timining information\n");
+	    timer_init();
 	    if(!drmgr_register_module_load_event(module_load_event) ||
 	       !drmgr_register_thread_init_event(event_thread_init) ||
 	       !drmgr_register_thread_exit_event(event_thread_exit)){
@@ -730,18 +1492,93 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
 	    if (!drmgr_register_thread_init_event(event_thread_init) ||
 	        !drmgr_register_module_load_event(module_load_event) ||
 		!drmgr_register_thread_exit_event(event_thread_exit) ||
-		!drmgr_register_bb_app2app_event(event_bb_app2app, NULL) ||
-		!drmgr_register_bb_instrumentation_event(NULL /*analysis_func*/,
-				    event_app_instruction, NULL))
+		!drmgr_register_bb_instrumentation_event(event_bb_analysis,
+				    select_instrumentation_policy(), NULL))
 	    DR_ASSERT_MSG(false, "ERROR: Couldn't perform event subscription\n");
+	    if(per_block_callouts())
+		    dr_register_end_trace_event(event_end_trace);
 	    if(read_bytes_only.get_value() == true)
 		    dr_printf("> Roofline: Detecting Read Bytes only as requested\n");
 	    if(write_bytes_only.get_value() == true)
 		    dr_printf("> Roofline: Detecting Written Bytes only as requested\n");
+	    if(inline_count.get_value() == true)
+		    dr_printf("> Roofline: Counting with inline per-thread counters\n");
+	    else{
+		    DR_ASSERT_MSG(buffer_entries.get_value() >= 1, "> ERROR: --buffer_entries must be at least 1\n");
+		    mem_buf = drx_buf_create_trace_buffer(buffer_entries.get_value() * ThreadData::ref_stride, buffer_full);
+		    DR_ASSERT_MSG(mem_buf != NULL, "ERROR: Couldn't create the memory reference buffer\n");
+	    }
+	    if(instrument_roi_only.get_value() == true)
+		    dr_printf("> Roofline: Instrumenting basic blocks only inside regions of interest\n");
+	    if(call_graph.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --call_graph needs the clean calls, it cannot be used with --inline_count\n");
+		    dr_printf("> Roofline: Attributing flops and bytes to functions\n");
+	    }
+	    if(line_heatmap.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --line_heatmap needs the clean calls, it cannot be used with --inline_count\n");
+		    dr_printf("> Roofline: Gathering flops and bytes per source line\n");
+	    }
+	    if(alternate_runs.get_value() == true){
+		    DR_ASSERT_MSG(!sampling_enabled(), "> ERROR: --alternate_runs and --sample_rate cannot be used together\n");
+		    dr_printf("> Roofline: Alternating timed and counted invocations of each region of interest\n");
+		    timer_init();
+	    }
+	    if(detect_loops.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --detect_loops needs the clean calls, it cannot be used with --inline_count\n");
+		    DR_ASSERT_MSG(!roi_only_instrumentation(), "> ERROR: --detect_loops profiles the whole run, it cannot be used with --instrument_roi_only\n");
+		    // The program time loop points get their share of would be the instrumented run's
+		    DR_ASSERT_MSG(!alternate_runs.get_value(), "> ERROR: --detect_loops needs a separate timing run, it cannot be used with --alternate_runs\n");
+		    dr_printf("> Roofline: Detecting loops\n");
+	    }
+	    if(cache_sim.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --cache_sim needs the accessed addresses, it cannot be used with --inline_count\n");
+		    DR_ASSERT_MSG(!read_bytes_only.get_value() && !write_bytes_only.get_value(),
+				    "> ERROR: --cache_sim needs both reads and writes, it cannot be used with --read_bytes_only nor --write_bytes_only\n");
+		    dr_printf("> Roofline: Simulating the data caches\n");
+		    cache_sim_init(cache_config.get_value());
+		    Point::cache_levels = cache_sim_levels();
+	    }
+	    if(footprint.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --footprint needs the accessed addresses, it cannot be used with --inline_count\n");
+		    DistinctCounter::exact = footprint_exact.get_value();
+		    dr_printf("> Roofline: Tracking the memory footprint%s\n", footprint_exact.get_value() ? " exactly" : "");
+	    }
+	    if(reuse_distance.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --reuse_distance needs the accessed addresses, it cannot be used with --inline_count\n");
+		    dr_printf("> Roofline: Computing reuse distances, tracking %.2f%% of the lines\n", reuse_sample_rate.get_value() * 100);
+		    reuse_distance_init(reuse_sample_rate.get_value());
+	    }
+	    if(false_sharing.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --false_sharing needs the accessed addresses, it cannot be used with --inline_count\n");
+		    DR_ASSERT_MSG(!read_bytes_only.get_value() && !write_bytes_only.get_value(),
+				    "> ERROR: --false_sharing needs both reads and writes, it cannot be used with --read_bytes_only nor --write_bytes_only\n");
+		    dr_printf("> Roofline: Detecting false sharing\n");
+		    false_sharing_init();
+	    }
+	    if(access_patterns.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --access_patterns needs the accessed addresses, it cannot be used with --inline_count\n");
+		    dr_printf("> Roofline: Classifying memory access patterns\n");
+	    }
+	    if(alignment.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --alignment needs the accessed addresses, it cannot be used with --inline_count\n");
+		    dr_printf("> Roofline: Counting misaligned and line splitting accesses\n");
+	    }
+	    if(allocations.get_value() == true){
+		    DR_ASSERT_MSG(!inline_count.get_value(), "> ERROR: --allocations needs the accessed addresses, it cannot be used with --inline_count\n");
+		    dr_printf("> Roofline: Attributing bytes to allocation sites\n");
+		    allocations_init();
+	    }
+	    if(stack_bytes.get_value() == true)
+		    dr_printf("> Roofline: Splitting stack and non-stack bytes\n");
     }
+    // Loops need the timer for the time of the whole program
+    if(detect_loops.get_value() == true)
+	    loop_detector_init();
 
 
     client_id = id;
+    exited_threads_lock = dr_mutex_create();
+    wrap_lock = dr_mutex_create();
 
     tls_idx = drmgr_register_tls_field();
     DR_ASSERT(tls_idx != -1);
@@ -771,4 +1608,8 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
 	    std::string output_file = output_folder.get_value() + file_name; 
 	    out_file = dr_open_file(output_file.c_str(), DR_FILE_WRITE_OVERWRITE);
     }
+    if(alternate_runs.get_value()){
+	    std::string output_file = output_folder.get_value() + "/roofline_time.xml";
+	    time_out_file = dr_open_file(output_file.c_str(), DR_FILE_WRITE_OVERWRITE);
+    }
 }
@@ -1,8 +1,32 @@
 #include"point.hpp"
+#include"symbols.hpp"
+
+bool Point::cache_traffic_enabled = false;
+unsigned int Point::cache_levels = 0;
+bool Point::footprint_enabled = false;
+bool Point::reuse_distance_enabled = false;
+bool Point::access_patterns_enabled = false;
+bool Point::alignment_enabled = false;
+bool Point::allocations_enabled = false;
+bool Point::stack_bytes_enabled = false;
 
 Point::Point(){
 	start = 0.0;
 	end = 0.0;
+	cpu_start = 0.0;
+	cpu_time = 0.0;
+	samples = 0;
+	invocations = 0;
+	sample_flops_sum = 0.0;
+	sample_flops_sq_sum = 0.0;
+	sample_bytes_sum = 0.0;
+	sample_bytes_sq_sum = 0.0;
+	instructions = 0;
+	functions_inclusive.clear();
+	functions_exclusive.clear();
+	call_paths.clear();
+	lines.clear();
+	cache_traffic = cache_traffic_t{};
 	line_number_start=0;
 	line_number_end=0;
 	flops=0;
@@ -37,19 +61,19 @@ void Point::set_src_file_end(std::string src_file){
 }
 
 
-void Point::update_read_bytes(ushort bytes_accessed){
-	read_bytes = read_bytes + (unsigned long long)bytes_accessed;
+void Point::update_read_bytes(unsigned long long bytes_accessed){
+	read_bytes = read_bytes + bytes_accessed;
 	return;
 }
 
-void Point::update_write_bytes(ushort bytes_accessed){
-	write_bytes = write_bytes + (unsigned long long)bytes_accessed;
+void Point::update_write_bytes(unsigned long long bytes_accessed){
+	write_bytes = write_bytes + bytes_accessed;
 	return;
 }
 
 
-void Point::update_bytes(ushort bytes_accessed){
-	bytes = bytes + (unsigned long long)bytes_accessed;
+void Point::update_bytes(unsigned long long bytes_accessed){
+	bytes = bytes + bytes_accessed;
 	return;
 }
 
@@ -65,8 +89,20 @@ void Point::set_end(double time_end){
 }
 
 
-void Point::update_fp_count(int fp_count){
-	flops = flops + (unsigned long long)fp_count;
+void Point::set_cpu_start(double cpu_time_start){
+	cpu_start = cpu_time_start;
+	return;
+}
+
+
+void Point::set_cpu_end(double cpu_time_end){
+	cpu_time = cpu_time + (cpu_time_end - cpu_start);
+	return;
+}
+
+
+void Point::update_fp_count(unsigned long long fp_count){
+	flops = flops + fp_count;
 	return;
 }
 
@@ -85,12 +121,182 @@ void Point::reset(){
 	line_number_end=0;
 	flops=0;
 	bytes=0;
+	read_bytes=0;
+	write_bytes=0;
+	// What a ROI gathers on top of flops and bytes has to start over as well
+	cpu_start = 0.0;
+	cpu_time = 0.0;
+	instructions = 0;
+	functions_inclusive.clear();
+	functions_exclusive.clear();
+	call_paths.clear();
+	lines.clear();
+	cache_traffic = cache_traffic_t{};
+	footprint.clear();
+	reuse_histogram.clear();
+	patterns.clear();
+	alignment.clear();
+	allocations.clear();
+	stack.clear();
 
 	return;
 
 }
 
-void Point::dump_info(file_t out_file, std::string actual_label){
+
+static void merge_call_graph_counters(std::map<std::string, call_graph_counters_t> &to,
+		const std::map<std::string, call_graph_counters_t> &from){
+	for(auto &entry : from){
+		auto it = to.find(entry.first);
+		if(it == to.end())
+			to[entry.first] = entry.second;
+		else
+			it->second.add(entry.second);
+	}
+}
+
+
+static void scale_call_graph_counters(std::map<std::string, call_graph_counters_t> &counters, double scale){
+	for(auto &entry : counters){
+		entry.second.flops = (unsigned long long)(entry.second.flops * scale + 0.5);
+		entry.second.bytes = (unsigned long long)(entry.second.bytes * scale + 0.5);
+		entry.second.read_bytes = (unsigned long long)(entry.second.read_bytes * scale + 0.5);
+		entry.second.write_bytes = (unsigned long long)(entry.second.write_bytes * scale + 0.5);
+		entry.second.instructions = (unsigned long long)(entry.second.instructions * scale + 0.5);
+	}
+}
+
+
+static void merge_line_counters(std::map<std::string, line_counters_t> &to,
+		const std::map<std::string, line_counters_t> &from){
+	for(auto &entry : from)
+		to[entry.first].add(entry.second);
+}
+
+
+static void scale_line_counters(std::map<std::string, line_counters_t> &counters, double scale){
+	for(auto &entry : counters){
+		entry.second.executions = (unsigned long long)(entry.second.executions * scale + 0.5);
+		entry.second.flops = (unsigned long long)(entry.second.flops * scale + 0.5);
+		entry.second.bytes = (unsigned long long)(entry.second.bytes * scale + 0.5);
+	}
+}
+
+
+void Point::merge(const Point &other){
+	flops = flops + other.flops;
+	bytes = bytes + other.bytes;
+	read_bytes = read_bytes + other.read_bytes;
+	write_bytes = write_bytes + other.write_bytes;
+	cpu_time = cpu_time + other.cpu_time;
+	samples = samples + other.samples;
+	invocations = invocations + other.invocations;
+	sample_flops_sum = sample_flops_sum + other.sample_flops_sum;
+	sample_flops_sq_sum = sample_flops_sq_sum + other.sample_flops_sq_sum;
+	sample_bytes_sum = sample_bytes_sum + other.sample_bytes_sum;
+	sample_bytes_sq_sum = sample_bytes_sq_sum + other.sample_bytes_sq_sum;
+	instructions = instructions + other.instructions;
+	merge_call_graph_counters(functions_inclusive, other.functions_inclusive);
+	merge_call_graph_counters(functions_exclusive, other.functions_exclusive);
+	merge_call_graph_counters(call_paths, other.call_paths);
+	merge_line_counters(lines, other.lines);
+	cache_traffic.add(other.cache_traffic);
+	footprint.merge(other.footprint);
+	reuse_histogram.merge(other.reuse_histogram);
+	patterns.merge(other.patterns);
+	alignment.merge(other.alignment);
+	allocations.merge(other.allocations);
+	stack.merge(other.stack);
+	// Wall time: from the first thread entering the ROI to the last one leaving it
+	if(other.start < start)
+		start = other.start;
+	if(other.end > end)
+		end = other.end;
+	return;
+}
+
+void Point::add_sample(const Point &sample){
+	if(samples == 0){
+		label = sample.label;
+		src_file_start = sample.src_file_start;
+		src_file_end = sample.src_file_end;
+		line_number_start = sample.line_number_start;
+		line_number_end = sample.line_number_end;
+	}
+	flops = flops + sample.flops;
+	bytes = bytes + sample.bytes;
+	read_bytes = read_bytes + sample.read_bytes;
+	write_bytes = write_bytes + sample.write_bytes;
+	// Time: the sum of the sampled invocations
+	end = end + (sample.end - sample.start);
+	cpu_time = cpu_time + sample.cpu_time;
+
+	samples++;
+	sample_flops_sum = sample_flops_sum + sample.flops;
+	sample_flops_sq_sum = sample_flops_sq_sum + (double)sample.flops * sample.flops;
+	sample_bytes_sum = sample_bytes_sum + sample.bytes;
+	sample_bytes_sq_sum = sample_bytes_sq_sum + (double)sample.bytes * sample.bytes;
+	instructions = instructions + sample.instructions;
+	merge_call_graph_counters(functions_inclusive, sample.functions_inclusive);
+	merge_call_graph_counters(functions_exclusive, sample.functions_exclusive);
+	merge_call_graph_counters(call_paths, sample.call_paths);
+	merge_line_counters(lines, sample.lines);
+	cache_traffic.add(sample.cache_traffic);
+	// The footprint of the sampled invocations is not extrapolated: touching the same lines again doesn't grow it
+	footprint.merge(sample.footprint);
+	reuse_histogram.merge(sample.reuse_histogram);
+	patterns.merge(sample.patterns);
+	alignment.merge(sample.alignment);
+	allocations.merge(sample.allocations);
+	stack.merge(sample.stack);
+	return;
+}
+
+
+void Point::extrapolate(unsigned long long total_invocations){
+	invocations = total_invocations;
+	if(samples == 0 || samples == invocations)
+		return;
+	double scale = (double)invocations / samples;
+	flops = (unsigned long long)(flops * scale + 0.5);
+	bytes = (unsigned long long)(bytes * scale + 0.5);
+	read_bytes = (unsigned long long)(read_bytes * scale + 0.5);
+	write_bytes = (unsigned long long)(write_bytes * scale + 0.5);
+	end = end * scale;
+	cpu_time = cpu_time * scale;
+	instructions = (unsigned long long)(instructions * scale + 0.5);
+	scale_call_graph_counters(functions_inclusive, scale);
+	scale_call_graph_counters(functions_exclusive, scale);
+	scale_call_graph_counters(call_paths, scale);
+	scale_line_counters(lines, scale);
+	for(int i = 0; i < CACHE_MAX_LEVELS; i++)
+		cache_traffic.level_bytes[i] = (unsigned long long)(cache_traffic.level_bytes[i] * scale + 0.5);
+	cache_traffic.dram_bytes = (unsigned long long)(cache_traffic.dram_bytes * scale + 0.5);
+	reuse_histogram.scale(scale);
+	patterns.scale(scale);
+	alignment.scale(scale);
+	allocations.scale(scale);
+	stack.scale(scale);
+	return;
+}
+
+
+// Unbiased variance of a per-invocation quantity, given its sum and sum of squares over n samples
+static double sample_variance(double sum, double sq_sum, unsigned long long n){
+	if(n < 2)
+		return 0.0;
+	double variance = (sq_sum - sum * sum / n) / (n - 1);
+	return variance > 0.0 ? variance : 0.0;
+}
+
+
+void Point::dump_info(file_t out_file, std::string actual_label, bool timing){
+	dump_begin(out_file, actual_label, timing);
+	dump_end(out_file);
+}
+
+
+void Point::dump_begin(file_t out_file, std::string actual_label, bool timing){
 
 #ifdef VALIDATE
 	dr_printf("Executed FP operations are: %llu \n", flops);
@@ -98,7 +304,7 @@ void Point::dump_info(file_t out_file, std::string actual_label){
 #endif
 
 	dr_fprintf(out_file, "<point label=\"%s\">\n", actual_label.c_str());
-	if(!time_run.get_value()){
+	if(!timing){
 		//This should be split between the threadData data structure and the point itself.
 		dr_fprintf(out_file, "<flops>%llu</flops>\n", flops);
 		dr_fprintf(out_file, "<bytes>%llu</bytes>\n", bytes);
@@ -108,17 +314,123 @@ void Point::dump_info(file_t out_file, std::string actual_label){
 		dr_fprintf(out_file, "<src_file_end>%s</src_file_end>\n", src_file_end.c_str());
 		dr_fprintf(out_file, "<line_n_start>%u</line_n_start>\n", line_number_start);
 		dr_fprintf(out_file, "<line_n_end>%u</line_n_end>\n",line_number_end);
+		if(cache_traffic_enabled){
+			// One element per level, the last one (if not L1) being reported as the last level cache too
+			for(unsigned int i = 0; i < cache_levels; i++)
+				dr_fprintf(out_file, "<l%u_bytes>%llu</l%u_bytes>\n", i + 1, cache_traffic.level_bytes[i], i + 1);
+			if(cache_levels > 1)
+				dr_fprintf(out_file, "<llc_bytes>%llu</llc_bytes>\n", cache_traffic.level_bytes[cache_levels - 1]);
+			dr_fprintf(out_file, "<dram_bytes>%llu</dram_bytes>\n", cache_traffic.dram_bytes);
+		}
+		if(footprint_enabled){
+			dr_fprintf(out_file, "<footprint_lines>%llu</footprint_lines>\n", footprint.lines());
+			dr_fprintf(out_file, "<footprint_pages_4k>%llu</footprint_pages_4k>\n", footprint.pages());
+			dr_fprintf(out_file, "<footprint_pages_2m>%llu</footprint_pages_2m>\n", footprint.huge_pages());
+		}
+		if(reuse_distance_enabled)
+			reuse_histogram.dump(out_file);
+		if(access_patterns_enabled)
+			patterns.dump(out_file);
+		if(alignment_enabled)
+			alignment.dump(out_file);
+		if(allocations_enabled)
+			allocations.dump(out_file);
+		if(stack_bytes_enabled)
+			stack.dump(out_file);
+		if(samples > 0){
+			// flops and bytes above are extrapolated to all the invocations
+			dr_fprintf(out_file, "<samples>%llu</samples>\n", samples);
+			dr_fprintf(out_file, "<invocations>%llu</invocations>\n", invocations);
+			dr_fprintf(out_file, "<flops_variance>%f</flops_variance>\n",
+					sample_variance(sample_flops_sum, sample_flops_sq_sum, samples));
+			dr_fprintf(out_file, "<bytes_variance>%f</bytes_variance>\n",
+					sample_variance(sample_bytes_sum, sample_bytes_sq_sum, samples));
+		}
 	}
 	else{
 		double elapsed = end - start;
-		dr_fprintf(out_file, "<time>%f</time>\n", elapsed);
+		dr_fprintf(out_file, "<time>%.9f</time>\n", elapsed);
+		dr_fprintf(out_file, "<cpu_time>%.9f</cpu_time>\n", cpu_time);
 #ifdef VALIDATE
 		dr_printf("Start time is: %f\n",start);
 		dr_printf("End time is: %f\n",end);
 		dr_printf("Elapsed time is: %f\n", elapsed);
 #endif
 	}
+	return;
+}
+
 
+void Point::dump_end(file_t out_file){
 	dr_fprintf(out_file, "</point>\n");
 	return;
 }
+
+
+void Point::dump_thread(file_t out_file, unsigned int tid, bool timing){
+	dr_fprintf(out_file, "<thread id=\"%u\">\n", tid);
+	if(!timing){
+		dr_fprintf(out_file, "<flops>%llu</flops>\n", flops);
+		dr_fprintf(out_file, "<bytes>%llu</bytes>\n", bytes);
+		dr_fprintf(out_file, "<read_bytes>%llu</read_bytes>\n", read_bytes);
+		dr_fprintf(out_file, "<write_bytes>%llu</write_bytes>\n", write_bytes);
+	}
+	else{
+		dr_fprintf(out_file, "<time>%.9f</time>\n", end - start);
+		dr_fprintf(out_file, "<cpu_time>%.9f</cpu_time>\n", cpu_time);
+	}
+	dr_fprintf(out_file, "</thread>\n");
+	return;
+}
+
+
+void Point::dump_call_paths(file_t out_file){
+	for(auto &path : call_paths){
+		dr_fprintf(out_file, "<call_path path=\"%s\">\n", xml_escape(path.first).c_str());
+		dr_fprintf(out_file, "<flops>%llu</flops>\n", path.second.flops);
+		dr_fprintf(out_file, "<bytes>%llu</bytes>\n", path.second.bytes);
+		dr_fprintf(out_file, "<read_bytes>%llu</read_bytes>\n", path.second.read_bytes);
+		dr_fprintf(out_file, "<write_bytes>%llu</write_bytes>\n", path.second.write_bytes);
+		dr_fprintf(out_file, "</call_path>\n");
+	}
+	return;
+}
+
+
+// Function points are labelled <ROI label>::<function>. They carry no time of their own:
+// their share of the ROI time is given by the fraction of its instructions they executed.
+void Point::dump_functions(file_t out_file, std::string actual_label){
+	for(auto &function : functions_inclusive){
+		const call_graph_counters_t &exclusive = functions_exclusive[function.first];
+		dr_fprintf(out_file, "<point label=\"%s::%s\">\n", actual_label.c_str(), xml_escape(function.first).c_str());
+		dr_fprintf(out_file, "<flops>%llu</flops>\n", function.second.flops);
+		dr_fprintf(out_file, "<bytes>%llu</bytes>\n", function.second.bytes);
+		dr_fprintf(out_file, "<read_bytes>%llu</read_bytes>\n", function.second.read_bytes);
+		dr_fprintf(out_file, "<write_bytes>%llu</write_bytes>\n", function.second.write_bytes);
+		dr_fprintf(out_file, "<exclusive_flops>%llu</exclusive_flops>\n", exclusive.flops);
+		dr_fprintf(out_file, "<exclusive_bytes>%llu</exclusive_bytes>\n", exclusive.bytes);
+		dr_fprintf(out_file, "<exclusive_read_bytes>%llu</exclusive_read_bytes>\n", exclusive.read_bytes);
+		dr_fprintf(out_file, "<exclusive_write_bytes>%llu</exclusive_write_bytes>\n", exclusive.write_bytes);
+		dr_fprintf(out_file, "<src_file_start>%s</src_file_start>\n", src_file_start.c_str());
+		dr_fprintf(out_file, "<src_file_end>%s</src_file_end>\n", src_file_end.c_str());
+		dr_fprintf(out_file, "<line_n_start>%u</line_n_start>\n", line_number_start);
+		dr_fprintf(out_file, "<line_n_end>%u</line_n_end>\n",line_number_end);
+		dr_fprintf(out_file, "<parent>%s</parent>\n", actual_label.c_str());
+		dr_fprintf(out_file, "<instr_fraction>%f</instr_fraction>\n",
+				instructions > 0 ? (double)function.second.instructions / instructions : 0.0);
+		dr_fprintf(out_file, "</point>\n");
+	}
+	return;
+}
+
+
+void Point::dump_lines(file_t out_file){
+	for(auto &line : lines){
+		dr_fprintf(out_file, "<line src=\"%s\">\n", xml_escape(line.first).c_str());
+		dr_fprintf(out_file, "<executions>%llu</executions>\n", line.second.executions);
+		dr_fprintf(out_file, "<flops>%llu</flops>\n", line.second.flops);
+		dr_fprintf(out_file, "<bytes>%llu</bytes>\n", line.second.bytes);
+		dr_fprintf(out_file, "</line>\n");
+	}
+	return;
+}
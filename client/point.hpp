@@ -3,11 +3,64 @@
 
 
 #include<string>
+#include<map>
 #include"dr_api.h"
 #include"droption.h"
+#include"footprint.hpp"
+#include"reuse_distance.hpp"
+#include"access_pattern.hpp"
+#include"alignment.hpp"
+#include"allocations.hpp"
+#include"stack_traffic.hpp"
 
 
-extern droption_t<bool> time_run;
+/* Counters of a function, or of a call path, within a ROI (--call_graph) */
+typedef struct _call_graph_counters_t {
+	unsigned long long flops;
+	unsigned long long bytes;
+	unsigned long long read_bytes;
+	unsigned long long write_bytes;
+	unsigned long long instructions; // Executed application instructions
+
+	void add(const struct _call_graph_counters_t &other){
+		flops += other.flops;
+		bytes += other.bytes;
+		read_bytes += other.read_bytes;
+		write_bytes += other.write_bytes;
+		instructions += other.instructions;
+	}
+} call_graph_counters_t;
+
+/* Counters of a source line within a ROI (--line_heatmap) */
+typedef struct _line_counters_t {
+	unsigned long long executions; // Executed instructions of the line
+	unsigned long long flops;
+	unsigned long long bytes;
+
+	void add(const struct _line_counters_t &other){
+		executions += other.executions;
+		flops += other.flops;
+		bytes += other.bytes;
+	}
+} line_counters_t;
+
+#define CACHE_MAX_LEVELS 4
+
+/* Traffic through the simulated memory hierarchy (--cache_sim), in bytes, per level:
+ * level_bytes[0] accessed by the core from L1, level_bytes[i] moved between level i and
+ * the one above it, whatever the number of simulated levels. The last of them is the last
+ * level cache, dram_bytes being moved between it and memory.
+ * */
+typedef struct _cache_traffic_t {
+	unsigned long long level_bytes[CACHE_MAX_LEVELS];
+	unsigned long long dram_bytes;
+
+	void add(const struct _cache_traffic_t &other){
+		for(int i = 0; i < CACHE_MAX_LEVELS; i++)
+			level_bytes[i] += other.level_bytes[i];
+		dram_bytes += other.dram_bytes;
+	}
+} cache_traffic_t;
 
 /* A Point is a simple representation for gathered performance data
  * for a specified (or detected) region of interest in the code.
@@ -33,14 +86,67 @@ class Point{
 		// Timing information
 		double start;
 		double end;
+		// Thread CPU time spent within the ROI, over all its executions
+		double cpu_start;
+		double cpu_time;
+
+		// Sampling (--sample_rate): instrumented invocations out of all of them, and the
+		// sums over the samples needed for the per-invocation mean and variance.
+		unsigned long long samples;
+		unsigned long long invocations;
+		double sample_flops_sum;
+		double sample_flops_sq_sum;
+		double sample_bytes_sum;
+		double sample_bytes_sq_sum;
+
+		// Call graph attribution (--call_graph): inclusive and exclusive totals per function,
+		// exclusive totals per call path ("main;solve;kernel"), and the instructions executed in the ROI.
+		std::map<std::string, call_graph_counters_t> functions_inclusive;
+		std::map<std::string, call_graph_counters_t> functions_exclusive;
+		std::map<std::string, call_graph_counters_t> call_paths;
+		unsigned long long instructions;
+
+		// Source line heatmap (--line_heatmap): totals per "file:line"
+		std::map<std::string, line_counters_t> lines;
+
+		// Simulated cache traffic (--cache_sim), dumped only when the simulation is enabled
+		cache_traffic_t cache_traffic;
+		static bool cache_traffic_enabled;
+		static unsigned int cache_levels;
+
+		// Distinct lines and pages touched (--footprint), dumped only when tracked
+		Footprint footprint;
+		static bool footprint_enabled;
+
+		// Reuse distance histogram (--reuse_distance), dumped only when gathered
+		ReuseHistogram reuse_histogram;
+		static bool reuse_distance_enabled;
+
+		// Bytes per access pattern (--access_patterns), dumped only when classified
+		PatternCounters patterns;
+		static bool access_patterns_enabled;
+
+		// Misaligned and line split accesses (--alignment), dumped only when counted
+		AlignmentCounters alignment;
+		static bool alignment_enabled;
+
+		// Bytes per allocation site (--allocations), dumped only when attributed
+		AllocationTraffic allocations;
+		static bool allocations_enabled;
+
+		// Stack bytes and spill candidates (--stack_bytes), dumped only when split
+		StackTraffic stack;
+		static bool stack_bytes_enabled;
 
 		//Setters
-		void update_bytes(ushort bytes_accessed);
-        void update_read_bytes(ushort bytes_accessed);
-        void update_write_bytes(ushort bytes_accessed);
-		void update_fp_count(int fp_count);
+		void update_bytes(unsigned long long bytes_accessed);
+        void update_read_bytes(unsigned long long bytes_accessed);
+        void update_write_bytes(unsigned long long bytes_accessed);
+		void update_fp_count(unsigned long long fp_count);
 		void set_start(double time_start);
 		void set_end(double time_end);
+		void set_cpu_start(double cpu_time_start);
+		void set_cpu_end(double cpu_time_end);
 		void set_label(std::string label);
 		void set_line_start(unsigned int src_file);
 		void set_line_end(unsigned int src_file);
@@ -51,7 +157,22 @@ class Point{
 		std::string get_label(void);
 
 		void reset();
-        void dump_info(file_t out_file, std::string actual_label);
+		// Accumulates the counters of the same ROI executed by another thread
+		void merge(const Point &other);
+		// Accumulates a sampled invocation of the same ROI
+		void add_sample(const Point &sample);
+		// Scales the counters summed over the samples to the given number of invocations
+		void extrapolate(unsigned long long total_invocations);
+		// timing: dump the timing information (roofline_time.xml) rather than the counters
+        void dump_info(file_t out_file, std::string actual_label, bool timing);
+		// dump_info split in two, so that per-thread details can be written in between
+		void dump_begin(file_t out_file, std::string actual_label, bool timing);
+		void dump_end(file_t out_file);
+		void dump_thread(file_t out_file, unsigned int tid, bool timing);
+		// Call graph: call paths within the point, and one point per function following it
+		void dump_call_paths(file_t out_file);
+		void dump_lines(file_t out_file);
+		void dump_functions(file_t out_file, std::string actual_label);
 
 };
 
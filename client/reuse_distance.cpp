@@ -0,0 +1,218 @@
+#include "reuse_distance.hpp"
+
+#define NO_NODE -1
+// Sampling threshold on the 24 high bits of the line hash, the best mixed ones of a multiplicative hash
+#define SAMPLING_MODULUS (1U << 24)
+
+static double sampling_rate = 1.0;
+static unsigned int sampling_threshold = SAMPLING_MODULUS;
+
+
+void reuse_distance_init(double sample_rate){
+	DR_ASSERT_MSG(sample_rate > 0.0 && sample_rate <= 1.0, "> ERROR: --reuse_sample_rate must be in (0, 1]\n");
+	sampling_threshold = (unsigned int)(sample_rate * SAMPLING_MODULUS);
+	if(sampling_threshold == 0)
+		sampling_threshold = 1;
+	sampling_rate = (double)sampling_threshold / SAMPLING_MODULUS;
+}
+
+
+// Lines have to be sampled uniformly, whatever the layout of the data
+static unsigned int hash_line(ptr_uint_t line){
+	uint64 hash = (uint64)line * 0x9e3779b97f4a7c15ULL;
+	return (unsigned int)(hash >> 40);
+}
+
+
+ReuseHistogram::ReuseHistogram(){
+	cold = 0;
+}
+
+
+void ReuseHistogram::add(unsigned long long distance){
+	unsigned int bin = 0;
+	while(distance > 0){
+		bin++;
+		distance >>= 1;
+	}
+	if(bin >= bins.size())
+		bins.resize(bin + 1, 0);
+	bins[bin]++;
+}
+
+
+void ReuseHistogram::add_cold(void){
+	cold++;
+}
+
+
+void ReuseHistogram::merge(const ReuseHistogram &other){
+	if(other.bins.size() > bins.size())
+		bins.resize(other.bins.size(), 0);
+	for(unsigned int bin = 0; bin < other.bins.size(); bin++)
+		bins[bin] += other.bins[bin];
+	cold += other.cold;
+}
+
+
+void ReuseHistogram::scale(double factor){
+	for(auto &bin : bins)
+		bin = (unsigned long long)(bin * factor + 0.5);
+	cold = (unsigned long long)(cold * factor + 0.5);
+}
+
+
+void ReuseHistogram::clear(void){
+	bins.clear();
+	cold = 0;
+}
+
+
+void ReuseHistogram::dump(file_t out_file){
+	dr_fprintf(out_file, "<reuse_distance line_size=\"%u\" sample_rate=\"%f\">\n", 1U << REUSE_LINE_SHIFT, sampling_rate);
+	for(unsigned int bin = 0; bin < bins.size(); bin++){
+		unsigned long long min = bin == 0 ? 0 : 1ULL << (bin - 1);
+		unsigned long long max = 1ULL << bin;
+		dr_fprintf(out_file, "<bin min=\"%llu\" max=\"%llu\">%llu</bin>\n",
+				min, max, (unsigned long long)(bins[bin] / sampling_rate + 0.5));
+	}
+	dr_fprintf(out_file, "<cold>%llu</cold>\n", (unsigned long long)(cold / sampling_rate + 0.5));
+	dr_fprintf(out_file, "</reuse_distance>\n");
+}
+
+
+ReuseDistance::ReuseDistance(){
+	root = NO_NODE;
+	clock = 0;
+	seed = 2463534242U;
+}
+
+
+void ReuseDistance::access(app_pc addr, unsigned int size, ReuseHistogram *histogram){
+	if(size == 0)
+		return;
+	ptr_uint_t first = (ptr_uint_t)addr >> REUSE_LINE_SHIFT;
+	ptr_uint_t last = ((ptr_uint_t)addr + size - 1) >> REUSE_LINE_SHIFT;
+	for(ptr_uint_t line = first; line <= last; line++){
+		if(hash_line(line) < sampling_threshold)
+			access_line(line, histogram);
+	}
+}
+
+
+// histogram is NULL for accesses which only keep the stack up to date
+void ReuseDistance::access_line(ptr_uint_t line, ReuseHistogram *histogram){
+	unsigned long long now = ++clock;
+	auto it = last_access.find(line);
+	if(it == last_access.end()){
+		last_access.emplace(line, now);
+		if(histogram != NULL)
+			histogram->add_cold();
+	}
+	else{
+		// Distinct sampled lines accessed in between, scaled back to all the lines
+		if(histogram != NULL)
+			histogram->add((unsigned long long)(count_greater(it->second) / sampling_rate));
+		erase(it->second);
+		it->second = now;
+	}
+	insert(now);
+}
+
+
+unsigned int ReuseDistance::size(int node){
+	return node == NO_NODE ? 0 : nodes[node].size;
+}
+
+
+void ReuseDistance::update(int node){
+	nodes[node].size = 1 + size(nodes[node].left) + size(nodes[node].right);
+}
+
+
+void ReuseDistance::split(int node, unsigned long long key, int *lower, int *higher){
+	if(node == NO_NODE){
+		*lower = NO_NODE;
+		*higher = NO_NODE;
+		return;
+	}
+	if(nodes[node].key < key){
+		int right_lower, right_higher;
+		split(nodes[node].right, key, &right_lower, &right_higher);
+		nodes[node].right = right_lower;
+		update(node);
+		*lower = node;
+		*higher = right_higher;
+	}
+	else{
+		int left_lower, left_higher;
+		split(nodes[node].left, key, &left_lower, &left_higher);
+		nodes[node].left = left_higher;
+		update(node);
+		*lower = left_lower;
+		*higher = node;
+	}
+}
+
+
+// All the keys of lower precede the ones of higher
+int ReuseDistance::merge(int lower, int higher){
+	if(lower == NO_NODE)
+		return higher;
+	if(higher == NO_NODE)
+		return lower;
+	if(nodes[lower].priority > nodes[higher].priority){
+		nodes[lower].right = merge(nodes[lower].right, higher);
+		update(lower);
+		return lower;
+	}
+	nodes[higher].left = merge(lower, nodes[higher].left);
+	update(higher);
+	return higher;
+}
+
+
+void ReuseDistance::insert(unsigned long long key){
+	// xorshift32: priorities only need to be random enough to keep the treap balanced
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	int node;
+	if(!free_nodes.empty()){
+		node = free_nodes.back();
+		free_nodes.pop_back();
+	}
+	else{
+		node = (int)nodes.size();
+		nodes.push_back(treap_node_t());
+	}
+	nodes[node] = treap_node_t{key, seed, 1, NO_NODE, NO_NODE};
+	int lower, higher;
+	split(root, key, &lower, &higher);
+	root = merge(merge(lower, node), higher);
+}
+
+
+void ReuseDistance::erase(unsigned long long key){
+	int lower, rest, node, higher;
+	split(root, key, &lower, &rest);
+	split(rest, key + 1, &node, &higher);
+	if(node != NO_NODE)
+		free_nodes.push_back(node);
+	root = merge(lower, higher);
+}
+
+
+unsigned long long ReuseDistance::count_greater(unsigned long long key){
+	unsigned long long count = 0;
+	int node = root;
+	while(node != NO_NODE){
+		if(nodes[node].key > key){
+			count += 1 + size(nodes[node].right);
+			node = nodes[node].left;
+		}
+		else
+			node = nodes[node].right;
+	}
+	return count;
+}
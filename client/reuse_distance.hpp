@@ -0,0 +1,79 @@
+#ifndef REUSE_DISTANCE_H
+#define REUSE_DISTANCE_H
+
+
+#include "dr_api.h"
+#include <unordered_map>
+#include <vector>
+
+/* Reuse distance analysis (--reuse_distance).
+ * The reuse distance of an access is the number of distinct cache lines accessed since the
+ * previous access to the same line (its LRU stack distance): a fully associative LRU cache
+ * of C lines misses exactly the accesses with a distance of at least C, plus the cold ones.
+ * Each thread keeps the last access time of each line, and an order statistic tree (a treap)
+ * of these times: the distance is the number of times in the tree following the previous one.
+ * To bound time and memory, lines are sampled by hashing their address (SHARDS): only those
+ * below --reuse_sample_rate are tracked, their distances and counts scaled back by the rate.
+ * Distances are gathered in log2 bins: bin 0 holds distance 0, bin k distances in [2^(k-1), 2^k).
+ * */
+
+#define REUSE_LINE_SHIFT 6
+
+// Sets the share of the lines which are tracked, in (0, 1]
+void reuse_distance_init(double sample_rate);
+
+
+class ReuseHistogram{
+public:
+  ReuseHistogram();
+  void add(unsigned long long distance);
+  void add_cold(void);
+  void merge(const ReuseHistogram &other);
+  void scale(double factor);
+  void clear(void);
+  // Writes the <reuse_distance> table, scaled back to all the accesses
+  void dump(file_t out_file);
+
+private:
+  std::vector<unsigned long long> bins;
+  unsigned long long cold;
+};
+
+
+class ReuseDistance{
+public:
+  ReuseDistance();
+  // An access of size bytes at addr, adding the distances of the lines it touches to histogram
+  void access(app_pc addr, unsigned int size, ReuseHistogram *histogram);
+
+private:
+  typedef struct _treap_node_t {
+    unsigned long long key;
+    unsigned int priority;
+    unsigned int size; // Nodes in the subtree
+    int left;
+    int right;
+  } treap_node_t;
+
+  // Last access time of each tracked line
+  std::unordered_map<ptr_uint_t, unsigned long long> last_access;
+  // The treap of the last access times, nodes referring to each other by index
+  std::vector<treap_node_t> nodes;
+  std::vector<int> free_nodes;
+  int root;
+  unsigned long long clock;
+  unsigned int seed;
+
+  void access_line(ptr_uint_t line, ReuseHistogram *histogram);
+  unsigned int size(int node);
+  void update(int node);
+  // Splits the subtree in the nodes with keys lower than key and the others
+  void split(int node, unsigned long long key, int *lower, int *higher);
+  int merge(int lower, int higher);
+  void insert(unsigned long long key);
+  void erase(unsigned long long key);
+  unsigned long long count_greater(unsigned long long key);
+};
+
+
+#endif
@@ -0,0 +1,175 @@
+#include "runtime_bytes.hpp"
+#include "active_lanes.hpp"
+#include "inline_counters.hpp"
+#include "drreg.h"
+#include "drutil.h"
+
+#define MINSERT instrlist_meta_preinsert
+
+
+bool is_runtime_sized_mem_instr(instr_t *instr){
+#ifdef X86
+	if(drutil_instr_is_stringop_loop(instr))
+		return true;
+#endif
+	return instr_is_gather(instr) || instr_is_scatter(instr) || is_masked_mem_instr(instr);
+}
+
+
+static opnd_t get_mem_opnd(instr_t *instr){
+	for(int i = 0; i < instr_num_srcs(instr); i++){
+		if(opnd_is_memory_reference(instr_get_src(instr, i)))
+			return instr_get_src(instr, i);
+	}
+	for(int i = 0; i < instr_num_dsts(instr); i++){
+		if(opnd_is_memory_reference(instr_get_dst(instr, i)))
+			return instr_get_dst(instr, i);
+	}
+	return opnd_create_null();
+}
+
+
+// Lanes of a gather/scatter: as many as fit the vector register it writes or reads, each one
+// accessing an element of its memory operand (the only part rep string operations make use of).
+static masked_lanes_t get_gather_scatter_lanes(instr_t *instr){
+	uint elem_size = opnd_size_in_bytes(opnd_get_size(get_mem_opnd(instr)));
+	reg_id_t mask = get_governing_reg(instr);
+#ifdef X86
+	// AVX2 gathers: the mask is the only vector register source (the index lives in the VSIB operand)
+	for(int i = 0; mask == DR_REG_NULL && i < instr_num_srcs(instr); i++){
+		opnd_t opnd = instr_get_src(instr, i);
+		if(opnd_is_reg(opnd) && (reg_is_strictly_xmm(opnd_get_reg(opnd)) || reg_is_strictly_ymm(opnd_get_reg(opnd))))
+			mask = opnd_get_reg(opnd);
+	}
+#endif
+	opnd_t vec = instr_is_gather(instr) ? instr_get_dst(instr, 0) : opnd_create_null();
+	for(int i = 0; instr_is_scatter(instr) && i < instr_num_srcs(instr); i++){
+		opnd_t opnd = instr_get_src(instr, i);
+		if(opnd_is_reg(opnd) && reg_is_simd(opnd_get_reg(opnd)))
+			vec = opnd;
+	}
+	uint lanes = opnd_is_reg(vec) && elem_size > 0 ? opnd_size_in_bytes(reg_get_size(opnd_get_reg(vec))) / elem_size : 0;
+	return masked_lanes_t{mask, lanes, elem_size, elem_size, 0};
+}
+
+
+static int log2_size(uint size){
+	int shift = 0;
+	while((1u << shift) < size)
+		shift++;
+	return shift;
+}
+
+
+static void insert_shift_left(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t reg, int shift){
+	if(shift == 0)
+		return;
+#ifdef X86
+	MINSERT(ilist, where, INSTR_CREATE_shl(drcontext, opnd_create_reg(reg), OPND_CREATE_INT8(shift)));
+#else
+	MINSERT(ilist, where, INSTR_CREATE_ubfm(drcontext, opnd_create_reg(reg), opnd_create_reg(reg),
+				OPND_CREATE_INT(64 - shift), OPND_CREATE_INT(63 - shift)));
+#endif
+}
+
+
+// Loads into reg_val the number of elements the instruction is going to access or compute on.
+static void insert_get_num_elems(void *drcontext, instrlist_t *ilist, instr_t *where,
+		reg_id_t reg_val, const masked_lanes_t &lanes){
+#ifdef X86
+	if(drutil_instr_is_stringop_loop(where)){
+		// Rep count register
+		drreg_get_app_value(drcontext, ilist, where, DR_REG_XCX, reg_val);
+		return;
+	}
+	reg_id_t reg_val_32 = reg_resize_to_opsz(reg_val, OPSZ_4);
+	if(reg_is_opmask(lanes.mask)){
+		// AVX-512: one bit per lane, bits past the vector length are ignored by the instruction.
+		// Byte and word elements get up to 64 lanes, read from the whole opmask.
+		if(lanes.lanes > 32)
+			MINSERT(ilist, where, INSTR_CREATE_kmovq(drcontext, opnd_create_reg(reg_val), opnd_create_reg(lanes.mask)));
+		else if(lanes.lanes > 16)
+			MINSERT(ilist, where, INSTR_CREATE_kmovd(drcontext, opnd_create_reg(reg_val_32), opnd_create_reg(lanes.mask)));
+		else
+			MINSERT(ilist, where, INSTR_CREATE_kmovw(drcontext, opnd_create_reg(reg_val_32), opnd_create_reg(lanes.mask)));
+		if(lanes.lanes < 16)
+			MINSERT(ilist, where, INSTR_CREATE_and(drcontext, opnd_create_reg(reg_val),
+						OPND_CREATE_INT32((1 << lanes.lanes) - 1)));
+	}
+	else{
+		// AVX2: a lane is active when the most significant bit of its mask element is set
+		if(lanes.lane_bytes == 8)
+			MINSERT(ilist, where, INSTR_CREATE_vmovmskpd(drcontext, opnd_create_reg(reg_val_32), opnd_create_reg(lanes.mask)));
+		else
+			MINSERT(ilist, where, INSTR_CREATE_vmovmskps(drcontext, opnd_create_reg(reg_val_32), opnd_create_reg(lanes.mask)));
+	}
+	MINSERT(ilist, where, INSTR_CREATE_popcnt(drcontext, opnd_create_reg(reg_val), opnd_create_reg(reg_val)));
+#else
+	// SVE: count the active elements of the governing predicate
+	DR_ASSERT_MSG(lanes.mask != DR_REG_NULL, "ERROR: Roofline Client - Runtime sized instruction without a governing predicate\n");
+	MINSERT(ilist, where, INSTR_CREATE_cntp_sve_pred(drcontext, opnd_create_reg(reg_val), opnd_create_reg(lanes.mask),
+				opnd_create_reg_element_vector(lanes.mask, opnd_size_from_bytes(lanes.lane_bytes))));
+#endif
+}
+
+
+// Reserves the arithmetic flags (x86), reg_val and reg_tmp (AArch64, DR_REG_NULL on x86).
+// reg_val is never the rep count register, whose app value may be read into it.
+static bool reserve_scratch(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t *reg_val, reg_id_t *reg_tmp){
+	drvector_t allowed;
+	drreg_init_and_fill_vector(&allowed, true);
+	IF_X86(drreg_set_vector_entry(&allowed, DR_REG_XCX, false));
+	*reg_tmp = DR_REG_NULL;
+	bool reserved = IF_X86_ELSE(drreg_reserve_aflags(drcontext, ilist, where), DRREG_SUCCESS) == DRREG_SUCCESS &&
+		drreg_reserve_register(drcontext, ilist, where, &allowed, reg_val) == DRREG_SUCCESS &&
+		IF_X86_ELSE(DRREG_SUCCESS, drreg_reserve_register(drcontext, ilist, where, NULL, reg_tmp)) == DRREG_SUCCESS;
+	drvector_delete(&allowed);
+	return reserved;
+}
+
+
+static void unreserve_scratch(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t reg_val, reg_id_t reg_tmp){
+	if(drreg_unreserve_register(drcontext, ilist, where, reg_val) != DRREG_SUCCESS ||
+	   IF_X86_ELSE(drreg_unreserve_aflags(drcontext, ilist, where),
+		       drreg_unreserve_register(drcontext, ilist, where, reg_tmp)) != DRREG_SUCCESS)
+		DR_ASSERT(false);
+}
+
+
+void insert_runtime_bytes(void *drcontext, instrlist_t *ilist, instr_t *where, int rw_slot){
+	masked_lanes_t lanes;
+	if(!get_masked_mem_lanes(where, &lanes))
+		lanes = get_gather_scatter_lanes(where);
+	reg_id_t reg_val, reg_tmp;
+	if(!reserve_scratch(drcontext, ilist, where, &reg_val, &reg_tmp)){
+		DR_ASSERT(false); /* cannot recover */
+		return;
+	}
+
+	insert_get_num_elems(drcontext, ilist, where, reg_val, lanes);
+	// Number of elements * element size
+	insert_shift_left(drcontext, ilist, where, reg_val, log2_size(lanes.elem_bytes));
+	insert_counter_add_reg(drcontext, ilist, where, MEMTRACE_TLS_OFFS_BYTES, reg_val, reg_tmp);
+	insert_counter_add_reg(drcontext, ilist, where, rw_slot, reg_val, reg_tmp);
+
+	unreserve_scratch(drcontext, ilist, where, reg_val, reg_tmp);
+}
+
+
+void insert_runtime_flops(void *drcontext, instrlist_t *ilist, instr_t *where){
+	masked_lanes_t lanes;
+	if(!get_masked_fp_lanes(where, &lanes))
+		return;
+	reg_id_t reg_val, reg_tmp;
+	if(!reserve_scratch(drcontext, ilist, where, &reg_val, &reg_tmp)){
+		DR_ASSERT(false); /* cannot recover */
+		return;
+	}
+
+	insert_get_num_elems(drcontext, ilist, where, reg_val, lanes);
+	// Active lanes * operations per lane (1, or 2 for the fused ones)
+	insert_shift_left(drcontext, ilist, where, reg_val, log2_size(lanes.ops));
+	insert_counter_add_reg(drcontext, ilist, where, MEMTRACE_TLS_OFFS_FP_COUNT, reg_val, reg_tmp);
+
+	unreserve_scratch(drcontext, ilist, where, reg_val, reg_tmp);
+}
@@ -0,0 +1,32 @@
+#ifndef RUNTIME_BYTES_H
+#define RUNTIME_BYTES_H
+
+
+#include "dr_api.h"
+
+/* Memory instructions whose accessed bytes are only known at runtime:
+ * - rep string operations (x86), accessing rep count * element size bytes. The conditional
+ *   repe/repne cmps and scas may stop early, on a match or mismatch: for them, this is an upper bound
+ * - gathers and scatters, accessing active lanes * element size bytes,
+ *   where the active lanes come from the governing mask (AVX2 vector mask,
+ *   AVX-512 opmask or SVE predicate)
+ * - masked (AVX-512) and predicated (SVE) contiguous vector loads and stores, likewise
+ * For these, inline code computes the bytes right before the instruction executes and
+ * adds them to the per-thread TLS counters (MEMTRACE_TLS_OFFS_*BYTES).
+ * Rep string operations then don't need to be expanded into loops anymore.
+ * These runtime sized accesses don't go through the memory reference buffer: the analyses built on the
+ * recorded addresses (heatmap, cache simulation, footprint, ...) don't see them. The README lists them.
+ * The FP operations of masked and predicated instructions are counted the same way, as
+ * active lanes * operations per lane, into MEMTRACE_TLS_OFFS_FP_COUNT (see active_lanes.hpp).
+ * */
+
+bool is_runtime_sized_mem_instr(instr_t *instr);
+
+// rw_slot is either MEMTRACE_TLS_OFFS_READ_BYTES or MEMTRACE_TLS_OFFS_WRITE_BYTES
+void insert_runtime_bytes(void *drcontext, instrlist_t *ilist, instr_t *where, int rw_slot);
+
+// Does nothing but for the masked or predicated FP instructions (see is_masked_fp_instr)
+void insert_runtime_flops(void *drcontext, instrlist_t *ilist, instr_t *where);
+
+
+#endif
@@ -0,0 +1,101 @@
+#include "stack_traffic.hpp"
+#include "symbols.hpp"
+#include <algorithm>
+#include <vector>
+
+#define MAX_REPORTED_PCS 10
+
+
+bool is_stack_opnd(opnd_t opnd){
+	if(!opnd_is_base_disp(opnd))
+		return false;
+	reg_id_t base = opnd_get_base(opnd);
+	if(base == DR_REG_NULL)
+		return false;
+	base = reg_to_pointer_sized(base);
+	return base == DR_REG_XSP || base == IF_X86_ELSE(DR_REG_XBP, DR_REG_X29);
+}
+
+
+bool is_spill_candidate(instr_t *instr){
+	if(instr_is_call(instr) || instr_is_return(instr))
+		return false;
+#ifdef FLOATING_POINTS_X86
+	switch(instr_get_opcode(instr)){
+	case OP_push:
+	case OP_push_imm:
+	case OP_pop:
+	case OP_pushf:
+	case OP_popf:
+	case OP_enter:
+	case OP_leave:
+		return false;
+	default:
+		break;
+	}
+#endif
+	return true;
+}
+
+
+StackTraffic::StackTraffic(){
+	clear();
+}
+
+
+void StackTraffic::add(app_pc pc, unsigned int size, bool write, bool spill){
+	if(write)
+		write_bytes += size;
+	else
+		read_bytes += size;
+	if(spill)
+		spill_pcs[pc] += size;
+}
+
+
+void StackTraffic::add_bytes(unsigned long long read, unsigned long long write){
+	read_bytes += read;
+	write_bytes += write;
+}
+
+
+void StackTraffic::merge(const StackTraffic &other){
+	read_bytes += other.read_bytes;
+	write_bytes += other.write_bytes;
+	for(auto &pc : other.spill_pcs)
+		spill_pcs[pc.first] += pc.second;
+}
+
+
+void StackTraffic::scale(double factor){
+	read_bytes = (unsigned long long)(read_bytes * factor + 0.5);
+	write_bytes = (unsigned long long)(write_bytes * factor + 0.5);
+	for(auto &pc : spill_pcs)
+		pc.second = (unsigned long long)(pc.second * factor + 0.5);
+}
+
+
+void StackTraffic::clear(void){
+	read_bytes = 0;
+	write_bytes = 0;
+	spill_pcs.clear();
+}
+
+
+void StackTraffic::dump(file_t out_file){
+	dr_fprintf(out_file, "<stack_bytes>\n");
+	dr_fprintf(out_file, "<read_bytes>%llu</read_bytes>\n", read_bytes);
+	dr_fprintf(out_file, "<write_bytes>%llu</write_bytes>\n", write_bytes);
+
+	std::vector<std::pair<app_pc, unsigned long long>> pcs(spill_pcs.begin(), spill_pcs.end());
+	std::sort(pcs.begin(), pcs.end(),
+			[](const std::pair<app_pc, unsigned long long> &a, const std::pair<app_pc, unsigned long long> &b){
+				return a.second > b.second; });
+	for(size_t i = 0; i < pcs.size() && i < MAX_REPORTED_PCS; i++){
+		std::string function, src;
+		lookup_pc_symbol(pcs[i].first, &function, &src);
+		dr_fprintf(out_file, "<spill_pc address=\"" PFX "\" function=\"%s\" src=\"%s\">%llu</spill_pc>\n",
+				pcs[i].first, xml_escape(function).c_str(), xml_escape(src).c_str(), pcs[i].second);
+	}
+	dr_fprintf(out_file, "</stack_bytes>\n");
+}
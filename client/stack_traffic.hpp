@@ -0,0 +1,45 @@
+#ifndef STACK_TRAFFIC_H
+#define STACK_TRAFFIC_H
+
+
+#include "dr_api.h"
+#include <map>
+
+/* Stack and non-stack traffic (--stack_bytes).
+ * Each memory operand is tagged when its block is built: it is a stack access when its base
+ * register is the stack pointer or the frame pointer. Stack accesses made by explicit operands,
+ * i.e. not by push, pop, call, ret and the like, are spill candidates: their bytes are kept per pc.
+ * Code built without frame pointers may use the frame pointer register for data: its accesses are
+ * then counted as stack ones.
+ * */
+
+// Whether the given memory operand addresses the stack
+bool is_stack_opnd(opnd_t opnd);
+// Whether the stack accesses of the given instruction are explicit: spills and reloads, locals
+bool is_spill_candidate(instr_t *instr);
+
+
+// The stack traffic of a ROI
+class StackTraffic{
+public:
+  StackTraffic();
+  unsigned long long read_bytes;
+  unsigned long long write_bytes;
+
+  // A stack access recorded in the memory reference buffer
+  void add(app_pc pc, unsigned int size, bool write, bool spill);
+  // Stack bytes of whole blocks (--inline_count): no pc
+  void add_bytes(unsigned long long read, unsigned long long write);
+  void merge(const StackTraffic &other);
+  void scale(double factor);
+  void clear(void);
+  // Writes the stack bytes, and the spill candidates accessing the most bytes
+  void dump(file_t out_file);
+
+private:
+  // Bytes accessed by each spill candidate
+  std::map<app_pc, unsigned long long> spill_pcs;
+};
+
+
+#endif
@@ -0,0 +1,74 @@
+/* Statically linked roi_api.
+ *
+ * The target application links DynamoRIO, the roofline client and this file statically
+ * and is run natively (no drrun). DynamoRIO takes control of the application only while a region
+ * of interest is open: everything outside of it runs fully native, with no translation overhead.
+ *
+ * Build the client with -DWITH_STATIC_ROI_API=ON, compile the application with -DROOFLINE_STATIC
+ * and link it against the roi_api target. Client options are passed through the environment:
+ *   DYNAMORIO_OPTIONS="-client_lib ';;--output_folder <dir>'" ./my_app
+ */
+
+#include "dr_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+// The ROI delimiters the client intercepts with drwrap, exactly as in the dynamic roi_api.h.
+// Here they are called once DynamoRIO has taken control, so that the client sees them.
+void _RoiStart(const char* label, unsigned int __line, const char* __file) __attribute__((noinline));
+void _RoiEnd(const char* label, unsigned int __line, const char* __file) __attribute__((noinline));
+
+void _RoiStart(const char* label, unsigned int __line, const char* __file){
+	__asm__ volatile("" ::: "memory");
+}
+
+void _RoiEnd(const char* label, unsigned int __line, const char* __file){
+	__asm__ volatile("" ::: "memory");
+}
+
+
+static int dr_is_setup = 0;
+// Number of regions of interest currently open. DynamoRIO is started when the
+// first one opens and stopped when the last one closes.
+static int open_rois = 0;
+// Makes the count update and the setup/start (or stop) it triggers a single step:
+// no thread gets into a ROI before DynamoRIO is set up and started.
+static pthread_mutex_t roi_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// The client only writes its output files on DynamoRIO exit.
+static void roi_api_exit(void){
+	if(dr_app_running_under_dynamorio())
+		dr_app_stop_and_cleanup();
+	else
+		dr_app_cleanup();
+}
+
+
+void _RoiStaticStart(const char* label, unsigned int __line, const char* __file){
+	pthread_mutex_lock(&roi_lock);
+	if(++open_rois == 1){
+		if(!dr_is_setup){
+			// DynamoRIO isn't set up yet: dr_fprintf can't be used
+			if(dr_app_setup() != 0){
+				fprintf(stderr, "> ERROR: Roofline - DynamoRIO setup failed\n");
+				abort();
+			}
+			atexit(roi_api_exit);
+			dr_is_setup = 1;
+		}
+		dr_app_start();
+	}
+	pthread_mutex_unlock(&roi_lock);
+	_RoiStart(label, __line, __file);
+}
+
+
+void _RoiStaticEnd(const char* label, unsigned int __line, const char* __file){
+	_RoiEnd(label, __line, __file);
+	pthread_mutex_lock(&roi_lock);
+	if(--open_rois == 0)
+		dr_app_stop();
+	pthread_mutex_unlock(&roi_lock);
+}
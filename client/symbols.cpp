@@ -0,0 +1,78 @@
+#include "symbols.hpp"
+#include "drsyms.h"
+
+#define MAX_SYMBOL_NAME 256
+
+
+bool lookup_pc_symbol(app_pc pc, pc_symbol_t *symbol){
+	symbol->function = "<unknown>";
+	symbol->module.clear();
+	symbol->module_offs = 0;
+	symbol->function_offs = 0;
+	symbol->file.clear();
+	symbol->line = 0;
+	symbol->is_entry = false;
+	module_data_t *mod = dr_lookup_module(pc);
+	if(mod == NULL)
+		return false;
+	const char *mod_name = dr_module_preferred_name(mod);
+	symbol->module = mod_name == NULL ? "unknown" : mod_name;
+	symbol->module_offs = pc - mod->start;
+
+	char name[MAX_SYMBOL_NAME], file[MAXIMUM_PATH];
+	drsym_info_t sym;
+	sym.struct_size = sizeof(sym);
+	sym.name = name;
+	sym.name_size = sizeof(name);
+	sym.file = file;
+	sym.file_size = sizeof(file);
+	drsym_error_t symres = drsym_lookup_address(mod->full_path, symbol->module_offs, &sym, DRSYM_DEMANGLE);
+	dr_free_module_data(mod);
+	if(symres != DRSYM_SUCCESS && symres != DRSYM_ERROR_LINE_NOT_AVAILABLE)
+		return false;
+	symbol->function = name;
+	symbol->function_offs = sym.start_offs;
+	symbol->is_entry = (sym.start_offs == symbol->module_offs);
+	if(symres == DRSYM_SUCCESS){
+		symbol->file = file;
+		symbol->line = sym.line;
+	}
+	return true;
+}
+
+
+std::string source_location(const pc_symbol_t &symbol){
+	if(!symbol.file.empty())
+		return symbol.file + ":" + std::to_string(symbol.line);
+	if(symbol.module.empty())
+		return "<unknown>";
+	char offset[32];
+	dr_snprintf(offset, sizeof(offset), "+0x%lx", (unsigned long)symbol.module_offs);
+	return "<" + symbol.module + ">" + offset;
+}
+
+
+void lookup_pc_symbol(app_pc pc, std::string *function, std::string *src){
+	pc_symbol_t symbol;
+	lookup_pc_symbol(pc, &symbol);
+	*function = symbol.function;
+	if(symbol.file.empty())
+		src->clear();
+	else
+		*src = symbol.file + ":" + std::to_string(symbol.line);
+}
+
+
+std::string xml_escape(const std::string &value){
+	std::string escaped;
+	for(char c : value){
+		switch(c){
+		case '<': escaped += "&lt;"; break;
+		case '>': escaped += "&gt;"; break;
+		case '&': escaped += "&amp;"; break;
+		case '"': escaped += "&quot;"; break;
+		default: escaped += c;
+		}
+	}
+	return escaped;
+}
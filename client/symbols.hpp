@@ -0,0 +1,33 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+
+#include "dr_api.h"
+#include <string>
+
+/* Naming application pcs in the reports: drsyms has to be initialized. */
+
+typedef struct _pc_symbol_t {
+	std::string function; // "<unknown>" without symbols
+	std::string module; // Preferred name of the module holding pc, empty outside any module
+	size_t module_offs;
+	size_t function_offs; // Offset of the function start into the module
+	std::string file; // Empty without line information
+	unsigned int line;
+	bool is_entry; // pc is the first instruction of its function
+} pc_symbol_t;
+
+// Returns false without a symbol for pc, leaving the module fields filled in when pc lies in a module
+bool lookup_pc_symbol(app_pc pc, pc_symbol_t *symbol);
+
+// "file:line" of the symbol, "<module>+offset" without line information, "<unknown>" outside any module
+std::string source_location(const pc_symbol_t &symbol);
+
+// Function holding pc ("<unknown>" without symbols) and its "file:line" (empty without line information)
+void lookup_pc_symbol(app_pc pc, std::string *function, std::string *src);
+
+// Escapes the characters demangled names may hold (templates, ...) which can't go verbatim in the XML
+std::string xml_escape(const std::string &value);
+
+
+#endif
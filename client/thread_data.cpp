@@ -1,21 +1,61 @@
 #include"thread_data.hpp"
+#include"timer.hpp"
+#include"false_sharing.hpp"
 #include"dr_api.h"
+#include<vector>
 
-ThreadData::ThreadData(int thread_id){
+ThreadData::ThreadData(void *thread_drcontext, int thread_id){
+  drcontext = thread_drcontext;
   tid = thread_id;
   cur_point = Point();
+  in_roi = false;
+  roi_start_detected = 0;
+  roi_end_detected = 0;
+  trace_f_point_created = false;
+  trace_f_call_id = 1;
+  roi_sampled = true;
+  roi_in_window = false;
+  roi_timed = false;
 
-  // Initialization for the buffer containting memory references
+  // The memory reference buffer itself is allocated, per thread, by drx_buf.
   seg_base = reinterpret_cast<byte*>(dr_get_dr_segment_base(tls_seg));
-  buf_base = reinterpret_cast<mem_ref_t*>(dr_raw_mem_alloc(MEM_BUF_SIZE,
-                              DR_MEMPROT_READ | DR_MEMPROT_WRITE, nullptr));
-// execution, such as BBV and LRU Stack Distance
-  DR_ASSERT(seg_base != nullptr && buf_base != nullptr);
+  DR_ASSERT(seg_base != nullptr);
   /* Keep seg_base in a per-thread data structure so we can get the TLS
-   * slot and find where the pointer points to in the buffer.
+   * slots holding the counters.
    */
+  for(int slot = 0; slot < MEMTRACE_TLS_COUNT; slot++){
+	  *(ptr_uint_t*)TLS_SLOT(seg_base, slot) = 0;
+	  counters_start[slot] = 0;
+  }
+}
+
+
+ptr_uint_t ThreadData::read_counter(int slot){
+	return *(ptr_uint_t*)TLS_SLOT(seg_base, slot);
+}
+
+
+void ThreadData::start_counters(void){
+	for(int slot = MEMTRACE_TLS_OFFS_FP_COUNT; slot < MEMTRACE_TLS_COUNT; slot++)
+		counters_start[slot] = read_counter(slot);
+}
+
 
-  BUF_PTR(seg_base) = buf_base;
+void ThreadData::stop_counters(void){
+	cur_point.update_fp_count(read_counter(MEMTRACE_TLS_OFFS_FP_COUNT) -
+			counters_start[MEMTRACE_TLS_OFFS_FP_COUNT]);
+	cur_point.update_bytes(read_counter(MEMTRACE_TLS_OFFS_BYTES) -
+			counters_start[MEMTRACE_TLS_OFFS_BYTES]);
+	cur_point.update_read_bytes(read_counter(MEMTRACE_TLS_OFFS_READ_BYTES) -
+			counters_start[MEMTRACE_TLS_OFFS_READ_BYTES]);
+	cur_point.update_write_bytes(read_counter(MEMTRACE_TLS_OFFS_WRITE_BYTES) -
+			counters_start[MEMTRACE_TLS_OFFS_WRITE_BYTES]);
+	cur_point.stack.add_bytes(read_counter(MEMTRACE_TLS_OFFS_STACK_READ_BYTES) -
+			counters_start[MEMTRACE_TLS_OFFS_STACK_READ_BYTES],
+			read_counter(MEMTRACE_TLS_OFFS_STACK_WRITE_BYTES) -
+			counters_start[MEMTRACE_TLS_OFFS_STACK_WRITE_BYTES]);
+	// Make a second stop without a start harmless
+	start_counters();
 }
 
 void ThreadData::save_floating_points(int fp_count){
@@ -24,8 +64,9 @@ void ThreadData::save_floating_points(int fp_count){
 }
 
 
-void ThreadData::set_time_start(double time_start){
+void ThreadData::set_time_start(double time_start, double cpu_time_start){
 	cur_point.set_start(time_start);
+	cur_point.set_cpu_start(cpu_time_start);
 #ifdef VALIDATE
 	dr_printf(">> Gathering timing information START <<\n");
 #endif
@@ -33,37 +74,245 @@ return;
 }
 
 
-void ThreadData::set_time_end(double time_end){
+void ThreadData::set_time_end(double time_end, double cpu_time_end){
 	cur_point.set_end(time_end);
+	cur_point.set_cpu_end(cpu_time_end);
 	return;
 }
 
-void ThreadData::save_bytes(void){
-	mem_ref_t *mem_ref, *buf_ptr;
-	buf_ptr = BUF_PTR(seg_base);
+// Feeds the given memory references, coming from the buffer, to the current point
+size_t ThreadData::ref_stride = sizeof(mem_ref_t);
+int ThreadData::ref_fixed_kind = -1;
+bool ThreadData::call_graph_enabled = false;
+bool ThreadData::line_heatmap_enabled = false;
+bool ThreadData::loop_detection_enabled = false;
+bool ThreadData::cache_sim_enabled = false;
+bool ThreadData::footprint_enabled = false;
+bool ThreadData::reuse_distance_enabled = false;
+bool ThreadData::false_sharing_enabled = false;
+bool ThreadData::access_patterns_enabled = false;
+bool ThreadData::alignment_enabled = false;
+bool ThreadData::allocations_enabled = false;
+bool ThreadData::stack_bytes_enabled = false;
 
-	for(mem_ref = (mem_ref_t *)(buf_base); mem_ref < buf_ptr; mem_ref++){
+void ThreadData::save_refs(byte *begin, byte *end, bool to_point){
+	unsigned long long bytes = 0, read_bytes = 0, write_bytes = 0;
+	for(byte *entry = begin; entry < end; entry += ref_stride){
+		mem_ref_t *mem_ref = reinterpret_cast<mem_ref_t*>(entry);
+		int kind = ref_fixed_kind < 0 ? mem_ref->type & MEM_REF_KIND : ref_fixed_kind;
+		// The read of a read-modify-write writes the data as well: the analyses splitting reads and writes count it as a write
+		bool write = kind == 1 || (mem_ref->type & MEM_REF_WRITES) != 0;
 #ifdef VALIDATE_VERBOSE
 		    dr_printf(">>Adding accessed Bytes: %lu ", mem_ref->size);
-		    dr_printf("accessed by instruction at @" PFX "\n", mem_ref->addr);
+		    if(ref_stride == sizeof(mem_ref_addr_t))
+			    dr_printf("at @" PFX " accessed by instruction at @" PFX,
+					    reinterpret_cast<mem_ref_addr_t*>(entry)->addr,
+					    reinterpret_cast<mem_ref_addr_t*>(entry)->pc);
+		    dr_printf("\n");
 #endif
-		    cur_point.update_bytes(mem_ref->size);
-            if(mem_ref->type == 0)
-                cur_point.update_read_bytes(mem_ref->size);
-            else if(mem_ref->type == 1)
-                cur_point.update_write_bytes(mem_ref->size);
+		    bytes += mem_ref->size;
+		    if(line_heatmap_enabled && to_point)
+			    heatmap.add_bytes(reinterpret_cast<mem_ref_addr_t*>(entry)->pc, mem_ref->size);
+		    if(false_sharing_enabled && to_point)
+			    false_sharing_access(tid, reinterpret_cast<mem_ref_addr_t*>(entry)->addr, mem_ref->size,
+					    write,
+					    reinterpret_cast<mem_ref_addr_t*>(entry)->pc);
+		    if(access_patterns_enabled && to_point)
+			    patterns.access(reinterpret_cast<mem_ref_addr_t*>(entry)->pc,
+					    reinterpret_cast<mem_ref_addr_t*>(entry)->addr, mem_ref->size);
+		    if(alignment_enabled && to_point)
+			    cur_point.alignment.add(reinterpret_cast<mem_ref_addr_t*>(entry)->pc,
+					    reinterpret_cast<mem_ref_addr_t*>(entry)->addr, mem_ref->size);
+		    if(stack_bytes_enabled && to_point && (mem_ref->type & MEM_REF_STACK) != 0)
+			    cur_point.stack.add(reinterpret_cast<mem_ref_addr_t*>(entry)->pc, mem_ref->size, write,
+					    (mem_ref->type & MEM_REF_SPILL) != 0);
+		    if(allocations_enabled && to_point)
+			    cur_point.allocations.add(allocation_lookup.site_of(reinterpret_cast<mem_ref_addr_t*>(entry)->addr),
+					    mem_ref->size, write);
+		    if(footprint_enabled && to_point)
+			    cur_point.footprint.add(reinterpret_cast<mem_ref_addr_t*>(entry)->addr, mem_ref->size);
+		    // Accesses drained outside the ROI (--detect_loops) still warm up the simulated caches and the LRU stack
+		    if(reuse_distance_enabled)
+			    reuse.access(reinterpret_cast<mem_ref_addr_t*>(entry)->addr, mem_ref->size,
+					    to_point ? &cur_point.reuse_histogram : NULL);
+		    if(cache_sim_enabled)
+			    cache.access(reinterpret_cast<mem_ref_addr_t*>(entry)->addr, mem_ref->size,
+					    write,
+					    (mem_ref->type & MEM_REF_NON_TEMPORAL) != 0);
+            if(kind == 0)
+                read_bytes += mem_ref->size;
+            else if(kind == 1)
+                write_bytes += mem_ref->size;
+	}
+	add_bytes(bytes, read_bytes, write_bytes, to_point);
+	if(cache_sim_enabled){
+		cache_traffic_t traffic = {};
+		cache.drain_traffic(traffic);
+		if(to_point)
+			cur_point.cache_traffic.add(traffic);
+	}
+	return;
+}
+
+
+void ThreadData::add_bytes(unsigned long long bytes, unsigned long long read_bytes, unsigned long long write_bytes, bool to_point){
+	if(to_point){
+		cur_point.update_bytes(bytes);
+		cur_point.update_read_bytes(read_bytes);
+		cur_point.update_write_bytes(write_bytes);
+		if(call_graph_enabled && bytes > 0)
+			call_stack.attribute(call_graph_counters_t{0, bytes, read_bytes, write_bytes, 0});
+	}
+	if(loop_detection_enabled && bytes > 0)
+		loops.attribute(call_graph_counters_t{0, bytes, read_bytes, write_bytes, 0});
+}
+
+
+void ThreadData::add_floating_points(unsigned long long fp_count, bool to_point){
+	if(fp_count == 0)
+		return;
+	if(to_point){
+		cur_point.update_fp_count(fp_count);
+		if(call_graph_enabled)
+			call_stack.attribute(call_graph_counters_t{fp_count, 0, 0, 0, 0});
+	}
+	if(loop_detection_enabled)
+		loops.attribute(call_graph_counters_t{fp_count, 0, 0, 0, 0});
+}
+
+
+void ThreadData::drain_bytes(bool to_point){
+	if(mem_buf != NULL){
+		byte *buf_base = reinterpret_cast<byte*>(drx_buf_get_buffer_base(drcontext, mem_buf));
+		byte *buf_ptr = reinterpret_cast<byte*>(drx_buf_get_buffer_ptr(drcontext, mem_buf));
+		save_refs(buf_base, buf_ptr, to_point);
+		drx_buf_set_buffer_ptr(drcontext, mem_buf, buf_base);
 	}
 
-	BUF_PTR(seg_base) = buf_base;
+	// Bytes only known at runtime (see runtime_bytes.hpp) are accumulated in the TLS counters instead
+	add_bytes(read_counter(MEMTRACE_TLS_OFFS_BYTES),
+			read_counter(MEMTRACE_TLS_OFFS_READ_BYTES),
+			read_counter(MEMTRACE_TLS_OFFS_WRITE_BYTES), to_point);
+	// So are the FP operations of the masked and predicated instructions (see active_lanes.hpp)
+	add_floating_points(read_counter(MEMTRACE_TLS_OFFS_FP_COUNT), to_point);
+	reset_counters();
 	     return;
 }
 
 
+void ThreadData::save_bytes(void){
+	drain_bytes(true);
+}
+
+
+// Whatever has been gathered so far belongs to the function (and loop) running before this block,
+// the flops and instructions of the block to its own function (and loop).
+void ThreadData::save_block(int fp_count, int func_id, bool is_entry, int instructions, app_pc tag, int loop_block, app_pc last_pc){
+	save_bytes();
+	save_floating_points(fp_count);
+	if(call_graph_enabled){
+		call_stack.enter_block(drcontext, func_id, is_entry, tag);
+		call_stack.attribute(call_graph_counters_t{(unsigned long long)fp_count, 0, 0, 0, (unsigned long long)instructions});
+		cur_point.instructions += instructions;
+	}
+	if(line_heatmap_enabled)
+		heatmap.add_block_execution(tag);
+	if(loop_detection_enabled){
+		loops.enter_block(loop_block, last_pc);
+		loops.attribute(call_graph_counters_t{(unsigned long long)fp_count, 0, 0, 0, (unsigned long long)instructions});
+	}
+}
+
+
+void ThreadData::follow_block(int fp_count, int func_id, bool is_entry, int instructions, app_pc tag, int loop_block, app_pc last_pc){
+	if(loop_detection_enabled){
+		drain_bytes(false);
+		loops.enter_block(loop_block, last_pc);
+		loops.attribute(call_graph_counters_t{(unsigned long long)fp_count, 0, 0, 0, (unsigned long long)instructions});
+	}
+	else
+		clean_buffer();
+	if(call_graph_enabled)
+		call_stack.enter_block(drcontext, func_id, is_entry, tag);
+}
+
+
+void ThreadData::reset_counters(void){
+	for(int slot = MEMTRACE_TLS_OFFS_FP_COUNT; slot < MEMTRACE_TLS_COUNT; slot++)
+		*(ptr_uint_t*)TLS_SLOT(seg_base, slot) = 0;
+}
+
+
 void ThreadData::clean_buffer(void){
-	BUF_PTR(seg_base) = buf_base;
+	if(mem_buf != NULL)
+		drx_buf_set_buffer_ptr(drcontext, mem_buf, reinterpret_cast<byte*>(drx_buf_get_buffer_base(drcontext, mem_buf)));
+	reset_counters();
+}
+
+
+ThreadData::sampled_roi_t &ThreadData::get_sampled_roi(std::string label){
+	auto it = sampled_rois.find(label);
+	if(it == sampled_rois.end()){
+		sampled_labels.push_back(label);
+		it = sampled_rois.emplace(label, sampled_roi_t{Point(), Point(), 0}).first;
+	}
+	return it->second;
+}
+
+
+bool ThreadData::sample_invocation(std::string label, unsigned int rate, bool random){
+	unsigned long long invocation = get_sampled_roi(label).invocations++;
+	if(rate <= 1)
+		return true;
+	if(random)
+		return dr_get_random_value(rate) == 0;
+	return invocation % rate == 0;
 }
 
 
+alternate_phase_t ThreadData::alternate_invocation(std::string label){
+	return (alternate_phase_t)(get_sampled_roi(label).invocations++ % 3);
+}
+
+
+void ThreadData::save_sample(unsigned int line, std::string src_file){
+	cur_point.set_line_end(line);
+	cur_point.set_src_file_end(src_file);
+	if(call_graph_enabled)
+		call_stack.save(cur_point);
+	if(line_heatmap_enabled)
+		heatmap.save(cur_point);
+	if(access_patterns_enabled)
+		patterns.save(cur_point.patterns);
+	sampled_roi_t &roi = sampled_rois[cur_point.get_label()];
+	if(roi_timed)
+		roi.timed_samples.add_sample(cur_point);
+	else
+		roi.samples.add_sample(cur_point);
+	cur_point.reset();
+}
+
+
+void ThreadData::save_samples(void){
+	for(auto &label : sampled_labels){
+		sampled_roi_t &roi = sampled_rois[label];
+		// Not a single invocation sampled: nothing to extrapolate from
+		if(roi.samples.samples == 0){
+			dr_printf("> WARNING: No invocation of '%s' has been sampled out of %llu\n",
+					label.c_str(), roi.invocations);
+			continue;
+		}
+		roi.samples.extrapolate(roi.invocations);
+		point_list.push_back(roi.samples);
+		if(roi.timed_samples.samples > 0){
+			roi.timed_samples.extrapolate(roi.invocations);
+			time_point_list.push_back(roi.timed_samples);
+		}
+	}
+	sampled_rois.clear();
+	sampled_labels.clear();
+}
+
 // Saves the point pushing it to the point list.
 void ThreadData::save_point(std::string label, unsigned int line, std::string src_file){
 	if(cur_point.get_label().compare(label) != 0){
@@ -84,6 +333,12 @@ void ThreadData::save_point(std::string label, unsigned int line, std::string sr
 
 	cur_point.set_line_end(line);
 	cur_point.set_src_file_end(src_file);
+	if(call_graph_enabled)
+		call_stack.save(cur_point);
+	if(line_heatmap_enabled)
+		heatmap.save(cur_point);
+	if(access_patterns_enabled)
+		patterns.save(cur_point.patterns);
 
 	// Add the point to the list
 	point_list.push_back(cur_point);
@@ -102,6 +357,9 @@ void ThreadData::new_point(std::string label, unsigned int line, std::string src
 #endif
 
 	cur_point.reset();
+	call_stack.clear_counters();
+	heatmap.clear();
+	patterns.clear();
 	cur_point.set_label(label);
 	cur_point.set_line_start(line);
 	cur_point.set_src_file_start(src_file);
@@ -112,24 +370,57 @@ void ThreadData::new_point(std::string label, unsigned int line, std::string src
 
 
 
-void ThreadData::save_to_file(file_t out_file){
+void save_to_file(file_t out_file, std::list<thread_points_t> &threads, bool timing,
+		void (*dump_extra_points)(file_t out_file, bool timing)){
+    threads.sort([](const thread_points_t &a, const thread_points_t &b){ return a.tid < b.tid; });
+
     // Upon saving the different data points, if some of them have the same label,
-    // make sure to output their name as label+ExecutionCount
-    std::unordered_map<std::string, int> execution_count;
-	for(std::list<Point>::iterator it = point_list.begin(); it != point_list.end(); it++){
-        std::string point_label = it->get_label();
-        auto search = execution_count.find(point_label);
-        // If it's not the first time we see a given label, let's save it with its execution number 
-        if(search != execution_count.end()){
-            it->dump_info(out_file, point_label + std::to_string(search->second));
-            execution_count[point_label] = execution_count[point_label] + 1;
+    // make sure to output their name as label+ExecutionCount.
+    // The n-th execution of a label is then merged across all the threads which executed it.
+    std::vector<std::string> labels;
+    std::unordered_map<std::string, std::vector<std::pair<unsigned int, Point*>>> label_points;
+    for(std::list<thread_points_t>::iterator thread = threads.begin(); thread != threads.end(); thread++){
+        std::unordered_map<std::string, int> execution_count;
+        for(std::list<Point>::iterator it = thread->point_list.begin(); it != thread->point_list.end(); it++){
+            std::string point_label = it->get_label();
+            auto search = execution_count.find(point_label);
+            // If it's not the first time we see a given label, let's save it with its execution number
+            if(search != execution_count.end()){
+                point_label = point_label + std::to_string(search->second);
+                search->second = search->second + 1;
+            }
+            // Else, let's keep track of this encounter
+            else{
+                execution_count[point_label] = 1;
+            }
+            if(label_points.find(point_label) == label_points.end())
+                labels.push_back(point_label);
+            label_points[point_label].push_back(std::make_pair(thread->tid, &(*it)));
         }
-        // Else, let's keep track of this encounter
-        else{
-            execution_count[point_label] = 1;
-            it->dump_info(out_file, point_label);
+    }
+
+    dr_fprintf(out_file, "<?xml version=\"1.0\"?>\n");
+    dr_fprintf(out_file, "<roofline>\n");
+    if(timing)
+        timer_dump_info(out_file);
+    for(std::vector<std::string>::iterator label = labels.begin(); label != labels.end(); label++){
+        std::vector<std::pair<unsigned int, Point*>> &points = label_points[*label];
+        Point total = *points[0].second;
+        for(size_t i = 1; i < points.size(); i++)
+            total.merge(*points[i].second);
+        total.dump_begin(out_file, *label, timing);
+        if(!timing){
+            total.dump_call_paths(out_file);
+            total.dump_lines(out_file);
         }
-        /// ELSLELELEEL
-	}
+        for(size_t i = 0; i < points.size(); i++)
+            points[i].second->dump_thread(out_file, points[i].first, timing);
+        total.dump_end(out_file);
+        if(!timing)
+            total.dump_functions(out_file, *label);
+    }
+    if(dump_extra_points != NULL)
+        dump_extra_points(out_file, timing);
+    dr_fprintf(out_file, "</roofline>\n");
 	return;
 }
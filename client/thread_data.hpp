@@ -3,45 +3,90 @@
 
 
 #include "dr_api.h"
+#include "droption.h"
+#include "drx.h"
 #include "point.hpp"
+#include "call_graph.hpp"
+#include "line_heatmap.hpp"
+#include "loop_detector.hpp"
+#include "cache_sim.hpp"
+#include "access_pattern.hpp"
+#include "allocations.hpp"
 #include <list>
 #include <unordered_map>
 
 /* Allocated TLS slot offsets */
 enum {
-    MEMTRACE_TLS_OFFS_BUF_PTR,
+    /* Per-thread counters updated inline from the code cache */
+    MEMTRACE_TLS_OFFS_FP_COUNT,
+    MEMTRACE_TLS_OFFS_BYTES,
+    MEMTRACE_TLS_OFFS_READ_BYTES,
+    MEMTRACE_TLS_OFFS_WRITE_BYTES,
+    /* Stack bytes of the blocks (--stack_bytes with --inline_count) */
+    MEMTRACE_TLS_OFFS_STACK_READ_BYTES,
+    MEMTRACE_TLS_OFFS_STACK_WRITE_BYTES,
     MEMTRACE_TLS_COUNT, /* total number of TLS slots allocated */
 };
 
 
-/* Each mem_ref_t is a <type, size, addr> entry representing a memory reference
- * instruction or the reference information, e.g.:
- * - mem ref instr: { type = 42 (call), size = 5, addr = 0x7f59c2d002d3 }
- * - mem ref info:  { type = 1 (write), size = 8, addr = 0x7ffeacab0ec8 }
- *   Andrea: For the time being I'm keeping this, since it may be useful for debugging.
+/* Each mem_ref_t is a <size, type> entry representing a memory reference:
+ * - { size = 8, type = 1 (write) }
+ * Single direction policies (--read_bytes_only, --write_bytes_only) don't store the type,
+ * all the entries share the same one (see ThreadData::ref_fixed_kind).
  */
 typedef struct _mem_ref_t {
-    ushort size; /* mem ref size or instr length */
-    ushort type; /* r(0), w(1), or opcode (assuming 0/1 are invalid opcode) */
-#ifdef VALIDATE_VERBOSE
-    app_pc addr; /* mem ref addr or instr pc */
-#endif
+    ushort size; /* mem ref size */
+    ushort type; /* r(0), w(1) */
 } mem_ref_t;
 
+/* Entries of the address-carrying policies: a mem_ref_t followed by
+ * the accessed address and the pc of the instruction accessing it.
+ */
+typedef struct _mem_ref_addr_t {
+    ushort size;
+    ushort type;
+    app_pc addr; /* mem ref addr */
+    app_pc pc;   /* instr pc */
+} mem_ref_addr_t;
+
+/* In the address-carrying entries, the type carries, above the r/w bit, how the access
+ * moves data through the caches (--cache_sim, --false_sharing) and whether it addresses the stack
+ * (--stack_bytes). These entries always store their type, whatever the direction policy.
+ */
+#define MEM_REF_KIND 0x1
+#define MEM_REF_WRITES 0x2       /* a read writing memory as well (e.g. add [mem], reg) */
+#define MEM_REF_NON_TEMPORAL 0x4 /* a non-temporal store */
+#define MEM_REF_STACK 0x8        /* based on the stack or frame pointer */
+#define MEM_REF_SPILL 0x10       /* an explicit stack operand: a spill candidate (see stack_traffic.hpp) */
+
 extern reg_id_t tls_seg;
 extern uint tls_offs;
+extern droption_t<bool> inline_count;
 
-/* Max number of mem_ref a buffer can have. It should be big enough
- * to hold all entries between clean calls.
+/* Per-thread memory reference buffer, a drx_buf trace buffer.
+ * It is followed by a guard page: when it fills up before the next clean call
+ * (long basic blocks, ...) the faulting store makes drx_buf call buffer_full(),
+ * which drains it, so it can never overflow whatever its size.
+ * NULL when counting inline.
  */
+extern drx_buf_t *mem_buf;
+
+/* Default number of mem_ref a buffer can hold (see --buffer_entries). */
 #define MAX_NUM_MEM_REFS 4096
-/* The maximum size of buffer for holding mem_refs. */
-#define MEM_BUF_SIZE (sizeof(mem_ref_t) * MAX_NUM_MEM_REFS)
 
 
-#define TLS_SLOT(tls_base, enum_val) (void **)((byte *)(tls_base) + tls_offs + (enum_val))
+// Each slot is pointer sized, enum_val is the slot index.
+#define TLS_OFFS(enum_val) (tls_offs + sizeof(void *) * (enum_val))
+#define TLS_SLOT(tls_base, enum_val) (void **)((byte *)(tls_base) + TLS_OFFS(enum_val))
 
-#define BUF_PTR(tls_base) *(mem_ref_t **)TLS_SLOT(tls_base, MEMTRACE_TLS_OFFS_BUF_PTR)
+/* --alternate_runs: the invocations of each ROI label go three at a time. The counted one flushes the
+ * code cache when it ends, the next one builds the uninstrumented blocks again, and the last one is timed.
+ */
+typedef enum {
+	ALTERNATE_COUNTED,
+	ALTERNATE_WARMUP,
+	ALTERNATE_TIMED
+} alternate_phase_t;
 
 
 
@@ -53,32 +98,130 @@ public:
     * for a better compariso
     * * */
   std::list<Point> point_list;
+  // Points of the timed invocations (--alternate_runs)
+  std::list<Point> time_point_list;
 
   unsigned int tid; // Thread id
 
-  ThreadData(int thread_id); // Constructor
+  // Region of interest state: each thread keeps its own,
+  // nothing is shared among threads on the clean call path.
+  bool in_roi;
+  unsigned int roi_start_detected;
+  unsigned int roi_end_detected;
+
+  // --trace_f bookkeeping
+  bool trace_f_point_created;
+  int trace_f_call_id;
+  std::string trace_f_last_label;
+
+  ThreadData(void *drcontext, int thread_id); // Constructor
 
   void save_bytes(void);
+  // to_point: the references belong to the current ROI, not only to the loops (--detect_loops)
+  void save_refs(byte *begin, byte *end, bool to_point);
   void save_floating_points(int fp_count);
-  void set_time_start(double start_time);
-  void set_time_end(double end_time);
+  void set_time_start(double start_time, double cpu_start_time);
+  void set_time_end(double end_time, double cpu_end_time);
   void new_point(std::string label, unsigned int line, std::string src_file);
   void save_point(std::string label, unsigned int line, std::string src_file);
   void clean_buffer(void);
-  void save_to_file(file_t out_file);
-
 
-  //TODO: Put back to private
-  mem_ref_t *buf_base;
+  // Call graph attribution (--call_graph), line heatmap (--line_heatmap) and loop detection (--detect_loops),
+  // from the clean call of each block: within a ROI save_block gathers the block, outside follow_block only
+  // keeps the shadow call stack in sync and gathers the loops, which are profiled over the whole run.
+  void save_block(int fp_count, int func_id, bool is_entry, int instructions, app_pc tag, int loop_block, app_pc last_pc);
+  void follow_block(int fp_count, int func_id, bool is_entry, int instructions, app_pc tag, int loop_block, app_pc last_pc);
+
+  LoopProfile loops;
+
+  // Sampling (--sample_rate, and --alternate_runs left out invocations): whether the current invocation of the ROI is recorded.
+  bool roi_sampled;
+  // --skip_calls/--up_to_call: whether the current invocation of the ROI falls within the window
+  bool roi_in_window;
+  // --alternate_runs: whether the current invocation of the ROI is timed rather than counted
+  bool roi_timed;
+  // Counts an invocation of the given ROI and tells whether it has to be sampled.
+  bool sample_invocation(std::string label, unsigned int rate, bool random);
+  // Counts an invocation of the given ROI and tells whether it has to be counted, timed or left out (see alternate_phase_t).
+  alternate_phase_t alternate_invocation(std::string label);
+  // Accumulates the current point as a sample of its ROI
+  void save_sample(unsigned int line, std::string src_file);
+  // Adds to the point lists, for each sampled ROI, the points extrapolated from its samples.
+  void save_samples(void);
+
+  // Inline counting: snapshot the TLS counters when a ROI starts,
+  // and add what has been counted in the meantime when it ends.
+  void start_counters(void);
+  void stop_counters(void);
+
+  // Layout of the memory reference buffer entries, set once by the instrumentation policy:
+  // size of an entry, and kind of all of them (-1 if each entry carries its type).
+  static size_t ref_stride;
+  static int ref_fixed_kind;
+  static bool call_graph_enabled;
+  static bool line_heatmap_enabled;
+  static bool loop_detection_enabled;
+  static bool cache_sim_enabled;
+  static bool footprint_enabled;
+  static bool reuse_distance_enabled;
+  static bool false_sharing_enabled;
+  static bool access_patterns_enabled;
+  static bool alignment_enabled;
+  static bool allocations_enabled;
+  static bool stack_bytes_enabled;
 
 private:
   // Status for the current point
   Point cur_point;
-  // Memory buffer containig those instructions which have not yet been
-  // fed to the treap.
+  void *drcontext;
+  // Base of the raw TLS slots, holding the inline counters
   byte *seg_base;
+  // TLS counter values at the beginning of the current ROI
+  ptr_uint_t counters_start[MEMTRACE_TLS_COUNT];
+
+  // Sampled ROIs, by label, in first seen order
+  typedef struct _sampled_roi_t {
+    Point samples;
+    Point timed_samples;
+    unsigned long long invocations;
+  } sampled_roi_t;
+  std::unordered_map<std::string, sampled_roi_t> sampled_rois;
+  std::list<std::string> sampled_labels;
+  sampled_roi_t &get_sampled_roi(std::string label);
+
+  ShadowCallStack call_stack;
+  LineHeatmap heatmap;
+  // Simulated data caches of the thread (--cache_sim), left empty otherwise
+  CacheHierarchy cache;
+  // LRU stack of the lines accessed by the thread (--reuse_distance)
+  ReuseDistance reuse;
+  // Address streams of the memory instructions within the ROI (--access_patterns)
+  AccessPatterns patterns;
+  // Last block looked up in the live allocations (--allocations)
+  AllocationLookup allocation_lookup;
+
+  // to_point: the bytes belong to the current ROI, not only to the loops
+  void drain_bytes(bool to_point);
+  void add_bytes(unsigned long long bytes, unsigned long long read_bytes, unsigned long long write_bytes, bool to_point);
+  void add_floating_points(unsigned long long fp_count, bool to_point);
+  ptr_uint_t read_counter(int slot);
+  void reset_counters(void);
 
 };
 
 
+/* Points gathered by a thread which has already exited */
+typedef struct _thread_points_t {
+  unsigned int tid;
+  std::list<Point> point_list;
+} thread_points_t;
+
+// Writes a single roofline document for all the threads: for each label, the aggregate
+// over the threads which executed it, together with the per-thread values.
+// timing tells whether it is roofline_time.xml. dump_extra_points, if any, writes further points
+// which are not gathered per thread (e.g. the detected loops).
+void save_to_file(file_t out_file, std::list<thread_points_t> &threads, bool timing,
+		void (*dump_extra_points)(file_t out_file, bool timing) = NULL);
+
+
 #endif
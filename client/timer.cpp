@@ -0,0 +1,144 @@
+#include "timer.hpp"
+#include <time.h>
+#include <stdint.h>
+#ifdef X86
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+// Calibration and measurement parameters
+#define CALIBRATION_SECONDS 0.02
+#define OVERHEAD_READINGS 1000
+
+static const char *source = "clock_monotonic_raw";
+static bool use_counter = false;
+// Counter value and CLOCK_MONOTONIC_RAW time at calibration, and counter frequency in Hz
+static uint64_t counter_origin;
+static double time_origin;
+static double counter_freq;
+static double resolution;
+static double overhead;
+
+
+static double clock_seconds(clockid_t clock_id){
+	struct timespec ts;
+	clock_gettime(clock_id, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+
+#if defined(X86)
+static inline uint64_t read_counter(void){
+	return __rdtsc();
+}
+
+// CPUID.80000007H:EDX[8]: the TSC rate does not change with P-, C- and T-states
+static bool counter_available(void){
+	unsigned int eax, ebx, ecx, edx;
+	if(!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return false;
+	return (edx & (1 << 8)) != 0;
+}
+#elif defined(AARCH64)
+static inline uint64_t read_counter(void){
+	uint64_t value;
+	// isb: don't let the read be speculated ahead of the preceding instructions
+	__asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(value) :: "memory");
+	return value;
+}
+
+static bool counter_available(void){
+	return true;
+}
+#else
+static inline uint64_t read_counter(void){
+	return 0;
+}
+
+static bool counter_available(void){
+	return false;
+}
+#endif
+
+
+// Counts the counter ticks within a CALIBRATION_SECONDS long CLOCK_MONOTONIC_RAW interval.
+static void calibrate(void){
+	double start = clock_seconds(CLOCK_MONOTONIC_RAW);
+	uint64_t counter_start = read_counter();
+	double now;
+	do{
+		now = clock_seconds(CLOCK_MONOTONIC_RAW);
+	} while(now - start < CALIBRATION_SECONDS);
+	uint64_t counter_end = read_counter();
+
+	counter_freq = (counter_end - counter_start) / (now - start);
+	counter_origin = counter_start;
+	time_origin = start;
+}
+
+
+void timer_init(void){
+	if(counter_available()){
+		calibrate();
+		if(counter_freq > 0){
+			use_counter = true;
+			source = IF_X86_ELSE("tsc", "cntvct");
+		}
+	}
+
+	// Smallest step of the wall clock: the first change between two readings
+	double first = timer_wall_time();
+	double second;
+	do{
+		second = timer_wall_time();
+	} while(second == first);
+	resolution = second - first;
+
+	double start = timer_wall_time();
+	for(int i = 0; i < OVERHEAD_READINGS; i++){
+		timer_wall_time();
+		timer_thread_cpu_time();
+	}
+	overhead = (timer_wall_time() - start) / OVERHEAD_READINGS;
+
+#ifdef VALIDATE
+	dr_printf("> Timer source: %s, %f Hz, resolution %g s, overhead %g s\n",
+			source, counter_freq, resolution, overhead);
+#endif
+}
+
+
+double timer_wall_time(void){
+	if(use_counter)
+		return time_origin + (int64_t)(read_counter() - counter_origin) / counter_freq;
+	return clock_seconds(CLOCK_MONOTONIC_RAW);
+}
+
+
+double timer_thread_cpu_time(void){
+	return clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+
+const char *timer_source(void){
+	return source;
+}
+
+
+double timer_resolution(void){
+	return resolution;
+}
+
+
+double timer_overhead(void){
+	return overhead;
+}
+
+
+void timer_dump_info(file_t out_file){
+	dr_fprintf(out_file, "<timer>\n");
+	dr_fprintf(out_file, "<source>%s</source>\n", source);
+	dr_fprintf(out_file, "<resolution>%.12f</resolution>\n", resolution);
+	dr_fprintf(out_file, "<overhead>%.12f</overhead>\n", overhead);
+	dr_fprintf(out_file, "</timer>\n");
+}
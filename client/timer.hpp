@@ -0,0 +1,31 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "dr_api.h"
+
+/* ROI timer.
+ * Wall time is read from the invariant TSC on x86 and from the generic timer
+ * (cntvct_el0) on AArch64, calibrated once against CLOCK_MONOTONIC_RAW.
+ * When no such counter is usable, CLOCK_MONOTONIC_RAW is read directly.
+ * CPU time is the per-thread CLOCK_THREAD_CPUTIME_ID.
+ * All times are in seconds.
+ */
+
+// Calibrates the counter and measures the timer resolution and overhead.
+// To be called once, before any other timer function.
+void timer_init(void);
+
+double timer_wall_time(void);
+double timer_thread_cpu_time(void);
+
+// Name of the wall time source: "tsc", "cntvct" or "clock_monotonic_raw"
+const char *timer_source(void);
+// Smallest non-zero difference between two consecutive wall time readings
+double timer_resolution(void);
+// Average cost of reading both the wall and the CPU time, as done at each ROI boundary
+double timer_overhead(void);
+
+// Writes the above timer information into a roofline document
+void timer_dump_info(file_t out_file);
+
+#endif
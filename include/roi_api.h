@@ -1,5 +1,21 @@
 #include<stdio.h>
 
+#ifdef ROOFLINE_STATIC
+// DynamoRIO is linked statically in the application (see client/static/roi_api.c):
+// it is started when a region of interest begins and stopped when it ends.
+#define Roi_Start(label) _RoiStaticStart(label, __LINE__, __FILE__)
+#define Roi_End(label) _RoiStaticEnd(label, __LINE__, __FILE__)
+#ifdef __cplusplus
+extern "C" {
+#endif
+void _RoiStaticStart(const char* label, unsigned int __line, const char* __file);
+void _RoiStaticEnd(const char* label, unsigned int __line, const char* __file);
+#ifdef __cplusplus
+}
+#endif
+
+#else
+
 #define Roi_Start(label) _RoiStart(label, __LINE__, __FILE__)
 #define Roi_End(label) _RoiEnd(label, __LINE__, __FILE__)
 void _RoiStart(const char* label, unsigned int __line, const char* __file) __attribute__((noinline, weak));
@@ -14,3 +30,4 @@ void _RoiStart(const char* label, unsigned int __line, const char* __file){
 void _RoiEnd(const char* label, unsigned int __line, const char* __file){
 }
 
+#endif
@@ -48,9 +48,15 @@ cwd = os.getcwd() + "/"
 
 drrun = roofline_tool_dir + "/dynamorio/build/bin64/drrun "
 
+# Memory levels of the simulated cache traffic (--cache_sim): as many cache levels as simulated,
+# the last one being the last level cache as well
+memory_levels = ['l1', 'l2', 'l3', 'l4', 'llc', 'dram']
+# Classes of the memory instructions (--access_patterns)
+access_patterns = ['constant', 'unit_stride', 'fixed_stride', 'irregular']
+
 
 class Point:
-    def __init__(self, total_flops, color, app_name, total_time, total_bytes, read_bytes, write_bytes ,flops_per_byte, gflops_per_sec, label, start_line, end_line, start_src, end_src):
+    def __init__(self, total_flops, color, app_name, total_time, total_bytes, read_bytes, write_bytes ,flops_per_byte, gflops_per_sec, label, start_line, end_line, start_src, end_src, cpu_time=None, level_bytes=None, footprint=None, reuse=None, patterns=None, alignment=None, allocations=None, stack=None):
         self.total_flops = total_flops
         self.color = color
         self.app_name = app_name
@@ -65,6 +71,21 @@ class Point:
         self.end_line = end_line
         self.start_src = start_src
         self.end_src = end_src
+        self.cpu_time = cpu_time
+        # Simulated bytes per memory level (--cache_sim), None if not simulated
+        self.level_bytes = level_bytes
+        # Distinct lines and pages touched (--footprint), None if not tracked
+        self.footprint = footprint
+        # Reuse distance histogram (--reuse_distance): line size, [(min, max, count)] and cold accesses
+        self.reuse = reuse
+        # Bytes per access pattern and top irregular pcs (--access_patterns), None if not classified
+        self.patterns = patterns
+        # Misaligned and line split accesses, and the offending pcs (--alignment), None if not counted
+        self.alignment = alignment
+        # Bytes per allocation site, and the unattributed ones (--allocations), None if not attributed
+        self.allocations = allocations
+        # Stack read and write bytes, and the top spill candidates (--stack_bytes), None if not split
+        self.stack = stack
 
     def get_point_coordinates(self):
         return("  {} 	{}\n".format(self.flops_per_byte, self.gflops_per_sec))
@@ -84,16 +105,74 @@ class Point:
             self.label, self.flops_per_byte, self.gflops_per_sec))
         print("       App Name: " + format(self.app_name))
         print("       Total Time: {}".format(self.total_time))
+        if self.cpu_time is not None:
+            print("       CPU Time: {}".format(self.cpu_time))
         print("       Total Flops: " + format(self.total_flops, "e"))
         print("       Total Bytes: " + format(self.total_bytes, "e"))
         print("       Read Bytes: " + format(self.read_bytes, "e"))
         print("       Write Bytes: " + format(self.write_bytes, "e"))
+        if self.level_bytes is not None:
+            for level in [level for level in memory_levels if level in self.level_bytes]:
+                print("       {} Bytes: ".format(level.upper()) + format(self.level_bytes[level], "e"))
+        if self.footprint is not None:
+            print("       Footprint: {} lines ({} KiB), {} 4 KiB pages, {} 2 MiB pages".format(
+                self.footprint['lines'], self.footprint['lines'] * 64 // 1024,
+                self.footprint['pages_4k'], self.footprint['pages_2m']))
+        if self.reuse is not None:
+            self.print_reuse_distance()
+        if self.patterns is not None:
+            print("       Access patterns: " + ", ".join("{} {}".format(pattern.replace('_', ' '), format(self.patterns[pattern], "e"))
+                                                       for pattern in access_patterns) + " bytes")
+            for pc in self.patterns['irregular_pcs']:
+                print("         irregular {} in {} {}: {} bytes".format(pc['address'], pc['function'], pc['src'], format(pc['bytes'], "e")))
+        if self.alignment is not None:
+            print("       Misaligned accesses: {}, line splits: {} ({} extra lines)".format(
+                self.alignment['misaligned'], self.alignment['line_splits'], self.alignment['extra_lines']))
+            for pc in self.alignment['offending_pcs']:
+                print("         {} in {} {}: {} misaligned, {} line splits".format(
+                    pc.get('address'), pc.get('function'), pc.get('src'), pc.get('misaligned'), pc.get('line_splits')))
+        if self.allocations is not None:
+            self.print_allocations()
+        if self.stack is not None:
+            stack_bytes = self.stack['read_bytes'] + self.stack['write_bytes']
+            non_stack_bytes = self.total_bytes - stack_bytes
+            print("       Stack Bytes: {} ({} read, {} written), non-stack: {} ({} FLOPs/Byte)".format(
+                format(stack_bytes, "e"), format(self.stack['read_bytes'], "e"), format(self.stack['write_bytes'], "e"),
+                format(non_stack_bytes, "e"), self.total_flops / non_stack_bytes if non_stack_bytes > 0 else "inf"))
+            for pc in self.stack['spill_pcs']:
+                print("         spill candidate {} in {} {}: {} bytes".format(pc['address'], pc['function'], pc['src'], format(pc['bytes'], "e")))
         print("       Start line number: {}".format(self.start_line))
         print("       Start source file: {}".format(self.start_src))
         print("       End line number: {}".format(self.end_line))
         print("       End line number: {}\n".format(self.end_src))
 
 
+    def print_allocations(self):
+        "Per data structure intensity: the flops of the ROI over the bytes of each allocation site"
+        print("       Allocation sites:")
+        for site in sorted(self.allocations['sites'], key=lambda s: s['read_bytes'] + s['write_bytes'], reverse=True):
+            site_bytes = site['read_bytes'] + site['write_bytes']
+            print("         {} in {} {} ({} allocations, up to {} bytes): {} read, {} written, {} FLOPs/Byte".format(
+                site['caller'], site['function'], site['src'], site['allocations'], site['max_size'],
+                format(site['read_bytes'], "e"), format(site['write_bytes'], "e"),
+                self.total_flops / site_bytes if site_bytes > 0 else "inf"))
+        print("         unattributed: {} read, {} written".format(
+            format(self.allocations['unattributed_read_bytes'], "e"), format(self.allocations['unattributed_write_bytes'], "e")))
+
+    def print_reuse_distance(self):
+        "Print the reuse distance histogram, with the miss ratio of a fully associative LRU cache as large as each bin bound"
+        total = self.reuse['cold'] + sum(count for _, _, count in self.reuse['bins'])
+        if total == 0:
+            return
+        print("       Reuse distance (lines of {} bytes): {} cold accesses".format(self.reuse['line_size'], self.reuse['cold']))
+        # Accesses with a distance of at least the cache size miss
+        misses = total
+        for bin_min, bin_max, count in self.reuse['bins']:
+            misses -= count
+            print("         [{}, {}): {}, miss ratio with {} KiB: {:.4f}".format(
+                bin_min, bin_max, count, bin_max * self.reuse['line_size'] / 1024, misses / total))
+
+
 def create_dat_file(out_dir, name, point_list):
     "Create a dat file which will be used by gnuplot to draw them"
     out_file = out_dir + "/" + name + ".dat"
@@ -123,8 +202,10 @@ def add_dat_file_reference(gnuplot_file, app_name, color):
     f.close()
 
 
-def get_points(in_dir, colour_n, name):
+def get_points(in_dir, colour_n, name, memory_level=None, exclude_stack=False):
     "Get the point piece of information parsing the XML file"
+    "memory_level: compute the arithmetic intensity from the bytes simulated at that level rather than from the accessed ones"
+    "exclude_stack: compute the arithmetic intensity from the non-stack bytes only, leaving register spills out"
 
     assert colour_n <= 5, "Please select less than 5 different files"
 
@@ -141,13 +222,83 @@ def get_points(in_dir, colour_n, name):
         src_file_end = p.find('src_file_end').text
         line_start = int(p.find('line_n_start').text)
         line_end = int(p.find('line_n_end').text)
+        level_bytes = None
+        if p.find('dram_bytes') is not None:
+            level_bytes = {level: float(p.find(level + '_bytes').text) for level in memory_levels
+                           if p.find(level + '_bytes') is not None}
+        footprint = None
+        if p.find('footprint_lines') is not None:
+            footprint = {key: int(p.find('footprint_' + key).text) for key in ['lines', 'pages_4k', 'pages_2m']}
+        reuse = None
+        reuse_element = p.find('reuse_distance')
+        if reuse_element is not None:
+            reuse = {'line_size': int(reuse_element.get('line_size')),
+                     'bins': [(int(b.get('min')), int(b.get('max')), int(b.text)) for b in reuse_element.findall('bin')],
+                     'cold': int(reuse_element.find('cold').text)}
+        patterns = None
+        patterns_element = p.find('access_patterns')
+        if patterns_element is not None:
+            patterns = {pattern: float(patterns_element.find(pattern + '_bytes').text) for pattern in access_patterns}
+            patterns['irregular_pcs'] = [{'address': pc.get('address'), 'function': pc.get('function'), 'src': pc.get('src'),
+                                          'bytes': float(pc.text)} for pc in patterns_element.findall('irregular_pc')]
+        alignment = None
+        alignment_element = p.find('alignment')
+        if alignment_element is not None:
+            alignment = {key: int(alignment_element.find(key).text) for key in ['misaligned', 'line_splits', 'extra_lines']}
+            alignment['offending_pcs'] = alignment_element.findall('offending_pc')
+        allocations = None
+        allocations_element = p.find('allocations')
+        if allocations_element is not None:
+            allocations = {'sites': [{'caller': s.get('caller'), 'function': s.get('function'), 'src': s.get('src'),
+                                      'allocations': int(s.get('allocations')), 'max_size': int(s.get('max_size')),
+                                      'read_bytes': float(s.get('read_bytes')), 'write_bytes': float(s.get('write_bytes'))}
+                                     for s in allocations_element.findall('site')],
+                           'unattributed_read_bytes': 0.0, 'unattributed_write_bytes': 0.0}
+            unattributed = allocations_element.find('unattributed')
+            if unattributed is not None:
+                allocations['unattributed_read_bytes'] = float(unattributed.get('read_bytes'))
+                allocations['unattributed_write_bytes'] = float(unattributed.get('write_bytes'))
+        stack = None
+        stack_element = p.find('stack_bytes')
+        if stack_element is not None:
+            stack = {key: float(stack_element.find(key).text) for key in ['read_bytes', 'write_bytes']}
+            stack['spill_pcs'] = [{'address': pc.get('address'), 'function': pc.get('function'), 'src': pc.get('src'),
+                                   'bytes': float(pc.text)} for pc in stack_element.findall('spill_pc')]
+        intensity_bytes = app_bytes
+        if exclude_stack:
+            assert stack is not None, "Point {} has no stack bytes: record it with --stack_bytes".format(label)
+            intensity_bytes = app_bytes - stack['read_bytes'] - stack['write_bytes']
+            if intensity_bytes <= 0.0:
+                continue
+        if memory_level is not None:
+            assert level_bytes is not None, "Point {} has no simulated cache traffic: record it with --cache_sim".format(label)
+            assert memory_level in level_bytes, "ERROR: Point {} has no simulated {} level".format(label, memory_level)
+            intensity_bytes = level_bytes[memory_level]
+            if intensity_bytes == 0.0:
+                continue
+        # Function points (--call_graph) and loop points (--detect_loops) have no time of their own:
+        # they get the share of their parent time given by the fraction of its instructions they executed
+        time_label = label
+        if p.find('parent') is not None:
+            time_label = p.find('parent').text
         # Get the correspondent element from the time xml file
         # Assert the label to be a unique ID, which must be present as well
         assert len(root_time.findall("point[@label='{}']".format(
-            label))) == 1, "Label {} not found or present multiple times! Have you defined it correctly?".format(label)
+            time_label))) == 1, "Label {} not found or present multiple times! Have you defined it correctly?".format(time_label)
         # Retrieve the timinig information corresponding to the same point from the timing file
-        app_time = float(root_time.findall(
-            "point[@label='{}']".format(label))[0].find('time').text)
+        time_point = root_time.findall("point[@label='{}']".format(time_label))[0]
+        app_time = float(time_point.find('time').text)
+        # Per-thread CPU time within the ROI, summed over the threads
+        cpu_time = None
+        if time_point.find('cpu_time') is not None:
+            cpu_time = float(time_point.find('cpu_time').text)
+        if p.find('parent') is not None:
+            fraction = float(p.find('instr_fraction').text)
+            app_time = app_time * fraction
+            if cpu_time is not None:
+                cpu_time = cpu_time * fraction
+            if app_time == 0.0:
+                continue
 
         assert app_time != 0.0, "Your application runtime looks like to be zero"
 
@@ -161,17 +312,44 @@ def get_points(in_dir, colour_n, name):
             total_bytes=app_bytes,
             read_bytes=read_bytes,
             write_bytes=write_bytes,
-            flops_per_byte=app_flops/app_bytes,
+            flops_per_byte=app_flops/intensity_bytes,
             gflops_per_sec=app_Gflops / app_time,
             label=label,
             start_line=line_start,
             end_line=line_end,
             start_src=src_file_start,
-            end_src=src_file_end))
+            end_src=src_file_end,
+            cpu_time=cpu_time,
+            level_bytes=level_bytes,
+            footprint=footprint,
+            reuse=reuse,
+            patterns=patterns,
+            alignment=alignment,
+            allocations=allocations,
+            stack=stack))
 
     return point_list
 
 
+def print_false_sharing(in_dir):
+    "Print the falsely shared cache lines found by --false_sharing, if any"
+    report = ET.parse(in_dir + '/roofline.xml').getroot().find('false_sharing')
+    if report is None:
+        return
+    print("False sharing in {}: {} lines".format(in_dir, report.get('lines')))
+    if int(report.get('untracked_accesses', '0')) > 0:
+        print("  {} accesses left out, the table was full".format(report.get('untracked_accesses')))
+    for line in report.findall('line'):
+        print("  Line {}: {} transfers, {} writes".format(line.get('address'), line.get('transfers'), line.get('writes')))
+        for thread in line.findall('thread'):
+            print("    Thread {}: wrote bytes {}, read bytes {}".format(
+                thread.get('id'), thread.get('written') or "-", thread.get('read') or "-"))
+        for pc in line.findall('pc'):
+            print("    {} {} by thread {} in {} {}".format(
+                pc.get('access'), pc.get('address'), pc.get('thread'), pc.get('function'), pc.get('src')))
+    print("")
+
+
 def ert_graph_is_available():
     "Checks out whether the Empirical Roofline Tool gnuplot is available"
 
@@ -186,10 +364,20 @@ def ert_graph_is_available():
     return True
 
 
-def run_client(app, options=[""]):
+def run_client(app, options=[""], static_roi=False):
     "Run the roofline client on the target app with the given options"
-    client_cmd = drrun + " -c {}/client/build/libroofline.so ".format(
-        roofline_tool_dir) + " ".join(options) + " -- " + app
+    if static_roi:
+        # DynamoRIO and the client are linked into the application itself (roi_api built with WITH_STATIC_ROI_API):
+        # just run it natively, passing the client options through the environment
+        # The shell looks names without a '/' up in PATH: only an executable of the current directory needs './'
+        exe = app.split()[0] if app.split() else app
+        if "/" not in exe and os.path.isfile(exe):
+            app = "./" + app
+        client_cmd = "DYNAMORIO_OPTIONS=\"-client_lib ';;{}'\" {}".format(
+            " ".join(options), app)
+    else:
+        client_cmd = drrun + " -c {}/client/build/libroofline.so ".format(
+            roofline_tool_dir) + " ".join(options) + " -- " + app
     print(client_cmd)
     sp.call(client_cmd, shell=True)
 
@@ -203,21 +391,50 @@ def run_roofline_client(args, app, out_dir=None):
                "--read_bytes_only" if args.read_bytes_only else "",
                "--write_bytes_only" if args.write_bytes_only else "",
                "--trace_f {}".format(args.trace_f) if args.trace_f else "",
-               "--calls_as_separate_roi" if args.calls_as_separate_roi else ""]
+               "--calls_as_separate_roi" if args.calls_as_separate_roi else "",
+               "--inline_count" if args.inline_count else "",
+               "--instrument_roi_only" if args.instrument_roi_only else "",
+               "--buffer_entries {}".format(args.buffer_entries) if args.buffer_entries else "",
+               "--sample_rate {}".format(args.sample_rate) if args.sample_rate else "",
+               "--sample_random" if args.sample_random else "",
+               "--skip_calls {}".format(args.skip_calls) if args.skip_calls else "",
+               "--up_to_call {}".format(args.up_to_call) if args.up_to_call else "",
+               "--call_graph" if args.call_graph else "",
+               "--line_heatmap" if args.line_heatmap else "",
+               "--detect_loops" if args.detect_loops else "",
+               "--loop_threshold {}".format(args.loop_threshold) if args.loop_threshold is not None else "",
+               "--cache_sim" if args.cache_sim else "",
+               "--cache_config {}".format(args.cache_config) if args.cache_config else "",
+               "--footprint" if args.footprint else "",
+               "--footprint_exact" if args.footprint_exact else "",
+               "--reuse_distance" if args.reuse_distance else "",
+               "--reuse_sample_rate {}".format(args.reuse_sample_rate) if args.reuse_sample_rate is not None else "",
+               "--false_sharing" if args.false_sharing else "",
+               "--access_patterns" if args.access_patterns else "",
+               "--alignment" if args.alignment else "",
+               "--allocations" if args.allocations else "",
+               "--stack_bytes" if args.stack_bytes else ""]
 
     if args.flops_only:
-        run_client(app, options=options)
+        run_client(app, options=options, static_roi=args.static_roi)
         sys.exit()
 
     if args.time_only:
         options.append("--time_run")
-        run_client(app, options=options)
+        run_client(app, options=options, static_roi=args.static_roi)
         sys.exit()
 
 
 
+    # Single run: the client alternates timed and counted invocations, writing both roofline.xml and roofline_time.xml
+    if args.alternate_runs:
+        assert not args.detect_loops, "ERROR: --detect_loops needs the program time of a separate, uninstrumented run: it cannot be used with --alternate_runs"
+        options.append("--alternate_runs")
+        run_client(app, options=options, static_roi=args.static_roi)
+        return
+
     # Memory and FP Run
-    run_client(app, options=options)
+    run_client(app, options=options, static_roi=args.static_roi)
 
     # TODO: Wrap this in an appropriate function
     # Time Run: add the appropriate flag to communicate this to the DynamoRIO client
@@ -228,7 +445,7 @@ def run_roofline_client(args, app, out_dir=None):
     if args.run_time_analysis > 1:
         run_time_analysis(args, app, options, out_dir)
     else:
-        run_client(app, options)
+        run_client(app, options, static_roi=args.static_roi)
 
 
 
@@ -238,7 +455,7 @@ def run_time_analysis(args, app, options, out_dir):
 
     ## Run the tool multiple times
     for i in range(0, args.run_time_analysis):
-            run_client(app, options)
+            run_client(app, options, static_roi=args.static_roi)
             move(out_dir + "roofline_time.xml", out_dir +
                     "roofline_time_{}.xml".format(i))
 
@@ -267,7 +484,7 @@ def run_time_analysis(args, app, options, out_dir):
     dynamorio_and_client_runtime = []
     for i in range(0, args.run_time_analysis):
         start = time.time()
-        run_client(app, options)
+        run_client(app, options, static_roi=args.static_roi)
         end = time.time()
         dynamorio_and_client_runtime.append(end - start)
 
@@ -449,7 +666,7 @@ def report(args):
     point_list = []
     for colour_n, in_dir in enumerate(args.input_dir):
         # Get points from the given input directory
-        current_points = get_points(in_dir, colour_n+1, get_app_title(in_dir))
+        current_points = get_points(in_dir, colour_n+1, get_app_title(in_dir), args.memory_level, args.exclude_stack)
         # Create its associated dat file in the given input directory.
         create_dat_file(in_dir, get_app_title(in_dir), current_points)
         # Copy the dat file onto the output directory
@@ -460,6 +677,9 @@ def report(args):
         # Update all point list
         point_list = point_list + current_points
 
+    for in_dir in args.input_dir:
+        print_false_sharing(in_dir)
+
     get_and_save_metainfo(args.input_dir, args.output_dir)
 
     for p in point_list:
@@ -650,6 +870,54 @@ def main():
         '--read_bytes_only', help='Take into account only bytes which are being read', action='store_true')
     record_parser.add_argument(
         '--write_bytes_only', help='Take into account only bytes which are being written', action='store_true')
+    record_parser.add_argument(
+        '--inline_count', help='Count FP operations and bytes with inline per-thread counters instead of a clean call per basic block (faster)', action='store_true')
+    record_parser.add_argument(
+        '--instrument_roi_only', help='Instrument the code only while a region of interest is open, flushing the code cache on ROI boundaries', action='store_true')
+    record_parser.add_argument(
+        '--buffer_entries', type=int, help='Number of entries of the per-thread memory reference buffer used by the client')
+    record_parser.add_argument(
+        '--sample_rate', type=int, help='Fully instrument only 1 in N invocations of each region of interest, extrapolating flops and bytes to all of them')
+    record_parser.add_argument(
+        '--sample_random', help='To be used with --sample_rate, samples each invocation with probability 1/N rather than every N-th one', action='store_true')
+    record_parser.add_argument(
+        '--skip_calls', type=int, help='Skip the first N invocations of the region of interest (e.g. warmup iterations)')
+    record_parser.add_argument(
+        '--up_to_call', type=int, help='Record only the M invocations following the skipped ones, then stop instrumenting the rest of the run')
+    record_parser.add_argument(
+        '--alternate_runs', help='Record in a single run: out of every three invocations of each region of interest, the first is counted and the third timed uninstrumented', action='store_true')
+    record_parser.add_argument(
+        '--call_graph', help='Attribute flops and bytes to the functions executed within each region of interest, each function becoming a point of its own', action='store_true')
+    record_parser.add_argument(
+        '--line_heatmap', help='Report flops, bytes and executed instructions per source line within each region of interest', action='store_true')
+    record_parser.add_argument(
+        '--detect_loops', help='Detect the loops of the application and report the hot ones as points, without any region of interest', action='store_true')
+    record_parser.add_argument(
+        '--loop_threshold', type=float, help='With --detect_loops, report only the loops executing at least this percentage of the program instructions (default 1)')
+    record_parser.add_argument(
+        '--cache_sim', help='Simulate the data caches, so that the report can plot the arithmetic intensity at each memory level (L1, L2, LLC, DRAM)', action='store_true')
+    record_parser.add_argument(
+        '--cache_config', help='Cache hierarchy to simulate, as <size>:<ways>:<line size> per level, e.g. 32K:8:64,1M:16:64 (default: read from sysfs)')
+    record_parser.add_argument(
+        '--footprint', help='Report the distinct 64 bytes lines, 4 KiB pages and 2 MiB pages touched by each region of interest (estimated)', action='store_true')
+    record_parser.add_argument(
+        '--footprint_exact', help='With --footprint, count the lines and pages exactly rather than estimating them', action='store_true')
+    record_parser.add_argument(
+        '--reuse_distance', help='Report a histogram of the reuse distances of the accesses of each region of interest, predicting the miss ratio of any cache size', action='store_true')
+    record_parser.add_argument(
+        '--reuse_sample_rate', type=float, help='With --reuse_distance, share of the cache lines tracked (default 0.01, 1 for all of them)')
+    record_parser.add_argument(
+        '--false_sharing', help='Detect the cache lines falsely shared among threads within the regions of interest', action='store_true')
+    record_parser.add_argument(
+        '--access_patterns', help='Classify the memory instructions of each region of interest as constant, unit stride, fixed stride or irregular', action='store_true')
+    record_parser.add_argument(
+        '--alignment', help='Count the misaligned and cache line splitting accesses of each region of interest, with the offending instructions', action='store_true')
+    record_parser.add_argument(
+        '--allocations', help='Attribute the bytes of each region of interest to the allocation sites of the accessed heap blocks, giving the intensity of each data structure', action='store_true')
+    record_parser.add_argument(
+        '--stack_bytes', help='Split the bytes of each region of interest into stack and non-stack ones, listing the spill candidates', action='store_true')
+    record_parser.add_argument(
+        '--static_roi', help='The target application has been linked against the static roi_api: run it natively, DynamoRIO takes control only inside regions of interest', action='store_true')
     record_parser.add_argument(
         '--flops_only', help='Run the roofline client to get flops and bytes information only', action='store_true')
     record_parser.set_defaults(func=record)
@@ -667,6 +935,10 @@ def main():
         '--no_shell_plot', help='Do not plot Roofline on the shell', action='store_true')
     report_parser.add_argument(
         '--title', help='Define a title for the roofline chart')
+    report_parser.add_argument(
+        '--memory_level', choices=memory_levels, help='Plot the arithmetic intensity with respect to the bytes moved at the given memory level (needs record --cache_sim)')
+    report_parser.add_argument(
+        '--exclude_stack', help='Plot the arithmetic intensity with respect to the non-stack bytes, leaving register spills out (needs record --stack_bytes)', action='store_true')
     report_parser.set_defaults(func=report)
 
     # Record ERT
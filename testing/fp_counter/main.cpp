@@ -49,6 +49,8 @@
 #include "drmgr.h"
 #include "droption.h"
 #include <string.h>
+#include "count_fp.hpp"
+#include "active_lanes.hpp"
 
 #ifdef WINDOWS
 #    define DISPLAY_STRING(msg) dr_messagebox(msg)
@@ -64,7 +66,15 @@ static droption_t<bool> only_from_app(
     "Count only instructions in the application itself, ignoring instructions in "
     "shared libraries.");
 
-bool is_fp_add(instr_t* instr);
+static droption_t<bool> check_fp_table(
+    DROPTION_SCOPE_CLIENT, "check_fp_table", false,
+    "Check the FP operations counted for known encodings, then count as usual",
+    "Decode a set of instructions whose FP operations are known, scalar and packed over each "
+    "vector length, and assert that count_fp_instr agrees with each of them. Likewise for the "
+    "lanes masked and predicated instructions are classified with (see active_lanes.hpp).");
+
+static void
+run_fp_table_checks(void);
 /* Application module */
 static app_pc exe_start;
 /* we only have a global count */
@@ -97,6 +107,8 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     if (!droption_parser_t::parse_argv(DROPTION_SCOPE_CLIENT, argc, argv, NULL, NULL))
         DR_ASSERT(false);
     drmgr_init();
+    if (check_fp_table.get_value())
+        run_fp_table_checks();
 
     /* Get main module address */
     if (only_from_app.get_value()) {
@@ -194,9 +206,7 @@ event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
             continue;
         if (!instr_is_app(instr))
             continue;
-	if(is_fp_add(instr)){
-		num_instrs++;
-	}
+	num_instrs += count_fp_instr(instr);
     }
     *user_data = (void *)(ptr_uint_t)num_instrs;
 
@@ -208,11 +218,124 @@ event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
 }
 
 
-bool is_fp_add(instr_t* instr){
-	if(instr_get_opcode(instr) == OP_fadd){
-		return true;
-	}
-	return false;
+/* Known encodings and the FP operations they perform */
+typedef struct _fp_check_t {
+    const char *name;
+    byte bytes[8];
+    uint32_t flops;
+} fp_check_t;
+
+static const fp_check_t fp_checks[] = {
+#ifdef FLOATING_POINTS_X86
+    { "addss xmm0, xmm1", { 0xf3, 0x0f, 0x58, 0xc1 }, 1 },
+    { "mulsd xmm0, xmm1", { 0xf2, 0x0f, 0x59, 0xc1 }, 1 },
+    { "addps xmm0, xmm1", { 0x0f, 0x58, 0xc1 }, 4 },
+    { "addpd xmm0, xmm1", { 0x66, 0x0f, 0x58, 0xc1 }, 2 },
+    { "xorps xmm0, xmm0", { 0x0f, 0x57, 0xc0 }, 0 },
+    { "fadd st0, st1", { 0xd8, 0xc1 }, 1 },
+    { "vaddps ymm0, ymm1, ymm2", { 0xc5, 0xf4, 0x58, 0xc2 }, 8 },
+    { "vfmadd231pd ymm0, ymm1, ymm2", { 0xc4, 0xe2, 0xf5, 0xb8, 0xc2 }, 8 },
+    { "vmulps zmm0, zmm1, zmm2", { 0x62, 0xf1, 0x74, 0x48, 0x59, 0xc2 }, 16 },
+    { "vfmadd231pd zmm0, zmm1, zmm2", { 0x62, 0xf2, 0xf5, 0x48, 0xb8, 0xc2 }, 16 },
+#else
+    /* Little endian A64 encodings */
+    { "fadd s0, s1, s2", { 0x20, 0x28, 0x22, 0x1e }, 1 },
+    { "fmadd d0, d1, d2, d3", { 0x20, 0x0c, 0x42, 0x1f }, 2 },
+    { "fadd d0, d1, d2", { 0x20, 0x28, 0x62, 0x1e }, 1 },
+    { "fadd v0.2s, v1.2s, v2.2s", { 0x20, 0xd4, 0x22, 0x0e }, 2 },
+    { "fadd v0.4s, v1.4s, v2.4s", { 0x20, 0xd4, 0x22, 0x4e }, 4 },
+    { "fmla v0.2d, v1.2d, v2.2d", { 0x20, 0xcc, 0x62, 0x4e }, 4 },
+    { "fmla v0.4s, v1.4s, v2.s[1]", { 0x20, 0x10, 0xa2, 0x4f }, 8 },
+    { "fcmla v0.4s, v1.4s, v2.4s, #0", { 0x20, 0xc4, 0x82, 0x6e }, 8 },
+    { "fcvtzs v0.4s, v1.4s", { 0x20, 0xb8, 0xa1, 0x4e }, 4 },
+    { "fmaxv s0, v1.4s", { 0x20, 0xf8, 0x30, 0x6e }, 3 },
+#endif
+};
+
+/* Known encodings of masked and predicated instructions, and how their active lanes are counted.
+ * fp_ops is 0 when the FP operations don't depend on the mask, mem_elem_bytes when the accessed
+ * bytes don't. lanes and lane_bytes are those of the FP operations, else of the memory access.
+ */
+typedef struct _lanes_check_t {
+    const char *name;
+    byte bytes[8];
+    uint fp_ops;
+    uint mem_elem_bytes;
+    uint lanes;
+    uint lane_bytes;
+} lanes_check_t;
+
+static const lanes_check_t lanes_checks[] = {
+#ifdef FLOATING_POINTS_X86
+    { "vaddps zmm0, zmm1, zmm2", { 0x62, 0xf1, 0x74, 0x48, 0x58, 0xc2 }, 0, 0, 0, 0 },
+    { "vaddps zmm0{k1}, zmm1, zmm2", { 0x62, 0xf1, 0x74, 0x49, 0x58, 0xc2 }, 1, 0, 16, 4 },
+    { "vfmadd231pd zmm0{k1}, zmm1, zmm2", { 0x62, 0xf2, 0xf5, 0x49, 0xb8, 0xc2 }, 2, 0, 8, 8 },
+    { "vaddps zmm0{k1}, zmm1, [rax]", { 0x62, 0xf1, 0x74, 0x49, 0x58, 0x00 }, 1, 4, 16, 4 },
+    { "vaddps zmm0{k1}, zmm1, [rax]{1to16}", { 0x62, 0xf1, 0x74, 0x59, 0x58, 0x00 }, 1, 0, 16, 4 },
+    { "vmovups zmm0{k1}, [rax]", { 0x62, 0xf1, 0x7c, 0x49, 0x10, 0x00 }, 0, 4, 16, 4 },
+    { "vmovupd [rax]{k1}, zmm0", { 0x62, 0xf1, 0xfd, 0x49, 0x11, 0x00 }, 0, 8, 8, 8 },
+#else
+    /* Little endian SVE encodings: the predicate counts the lanes */
+    { "fadd z0.s, z1.s, z2.s", { 0x20, 0x00, 0x82, 0x65 }, 0, 0, 0, 0 },
+    { "fadd z0.s, p0/m, z0.s, z1.s", { 0x20, 0x80, 0x80, 0x65 }, 1, 0, 0, 4 },
+    { "fmla z0.d, p1/m, z1.d, z2.d", { 0x20, 0x04, 0xe2, 0x65 }, 2, 0, 0, 8 },
+    { "ld1w {z0.s}, p0/z, [x0]", { 0x00, 0xa0, 0x40, 0xa5 }, 0, 4, 0, 4 },
+    { "ld1b {z0.s}, p0/z, [x0]", { 0x00, 0xa0, 0x40, 0xa4 }, 0, 1, 0, 4 },
+    { "st1d {z0.d}, p0, [x0]", { 0x00, 0xe0, 0xe0, 0xe5 }, 0, 8, 0, 8 },
+#endif
+};
+
+static void
+run_active_lanes_checks(void)
+{
+    int failures = 0;
+    for (const lanes_check_t &check : lanes_checks) {
+        instr_t instr;
+        instr_init(GLOBAL_DCONTEXT, &instr);
+        byte *next = decode(GLOBAL_DCONTEXT, (byte *)check.bytes, &instr);
+        DR_ASSERT_MSG(next != NULL, "> ERROR: Couldn't decode an active lanes check\n");
+        masked_lanes_t fp_lanes = {}, mem_lanes = {};
+        bool masked_fp = get_masked_fp_lanes(&instr, &fp_lanes);
+        bool masked_mem = get_masked_mem_lanes(&instr, &mem_lanes);
+        const masked_lanes_t &lanes = masked_fp ? fp_lanes : mem_lanes;
+        if (fp_lanes.ops != check.fp_ops || mem_lanes.elem_bytes != check.mem_elem_bytes ||
+            ((masked_fp || masked_mem) && (lanes.lanes != check.lanes || lanes.lane_bytes != check.lane_bytes))) {
+            dr_printf("> Active lanes check failed: %s counts %u FP operations and %u bytes per "
+                      "active lane over %u lanes of %u bytes, %u, %u, %u and %u expected\n",
+                      check.name, fp_lanes.ops, mem_lanes.elem_bytes, lanes.lanes, lanes.lane_bytes,
+                      check.fp_ops, check.mem_elem_bytes, check.lanes, check.lane_bytes);
+            failures++;
+        }
+        instr_free(GLOBAL_DCONTEXT, &instr);
+    }
+    dr_printf("> Active lanes checks: %d of %d passed\n",
+              (int)(sizeof(lanes_checks) / sizeof(lanes_checks[0])) - failures,
+              (int)(sizeof(lanes_checks) / sizeof(lanes_checks[0])));
+    DR_ASSERT_MSG(failures == 0, "> ERROR: Active lanes checks failed\n");
+}
+
+static void
+run_fp_table_checks(void)
+{
+    int failures = 0;
+    for (const fp_check_t &check : fp_checks) {
+        instr_t instr;
+        instr_init(GLOBAL_DCONTEXT, &instr);
+        byte *next = decode(GLOBAL_DCONTEXT, (byte *)check.bytes, &instr);
+        DR_ASSERT_MSG(next != NULL, "> ERROR: Couldn't decode a FP table check\n");
+        uint32_t flops = count_fp_instr(&instr);
+        if (flops != check.flops) {
+            dr_printf("> FP table check failed: %s counts %u FP operations, %u expected\n", check.name,
+                      flops, check.flops);
+            failures++;
+        }
+        instr_free(GLOBAL_DCONTEXT, &instr);
+    }
+    dr_printf("> FP table checks: %d of %d passed\n",
+              (int)(sizeof(fp_checks) / sizeof(fp_checks[0])) - failures,
+              (int)(sizeof(fp_checks) / sizeof(fp_checks[0])));
+    DR_ASSERT_MSG(failures == 0, "> ERROR: FP table checks failed\n");
+    run_active_lanes_checks();
 }
 
 
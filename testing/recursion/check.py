@@ -0,0 +1,16 @@
+#!/usr/bin/env python3
+"Checks the call paths recorded with --call_graph for the recursive quicksort of main.cpp"
+
+import sys
+import xml.etree.ElementTree as ET
+
+# Random input: the recursion stays far below this depth
+MAX_DEPTH = 200
+
+root = ET.parse(sys.argv[1]).getroot()
+paths = [path.get('path').split(';') for path in root.iter('call_path')]
+assert paths, "ERROR: No call path recorded, was --call_graph given?"
+deepest = max(len(path) for path in paths)
+assert deepest <= MAX_DEPTH, "ERROR: Call path {} functions deep: the shadow stack doesn't pop returning invocations".format(deepest)
+assert any(path.count('quicksort') > 1 for path in paths), "ERROR: No recursive call path of quicksort"
+print("{} call paths, at most {} functions deep".format(len(paths), deepest))
@@ -0,0 +1,57 @@
+#include<iostream>
+#include<random>
+#include<vector>
+
+/* A recursive quicksort, to check the shadow call stack of --call_graph:
+ * every invocation has to pop its frame when it returns, so that the reported call paths
+ * (roi_begin aside) are never deeper than the recursion itself. See check.py.
+ */
+
+extern "C" __attribute__((noinline)) void roi_begin(void){
+	asm volatile("");
+}
+
+extern "C" __attribute__((noinline)) void roi_finish(void){
+	asm volatile("");
+}
+
+__attribute__((noinline)) long partition(std::vector<double> &v, long lo, long hi){
+	double pivot = v[hi];
+	long i = lo;
+	for(long j = lo; j < hi; j++){
+		if(v[j] < pivot)
+			std::swap(v[i++], v[j]);
+	}
+	std::swap(v[i], v[hi]);
+	return i;
+}
+
+__attribute__((noinline)) void quicksort(std::vector<double> &v, long lo, long hi){
+	if(lo >= hi)
+		return;
+	long p = partition(v, lo, hi);
+	quicksort(v, lo, p - 1);
+	quicksort(v, p + 1, hi);
+}
+
+
+int main(int argc, char* argv[]){
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> dist(0.0, 1.0);
+	std::vector<double> v(1 << 16);
+	for(double &x : v)
+		x = dist(gen);
+
+	roi_begin();
+	quicksort(v, 0, v.size() - 1);
+	roi_finish();
+
+	for(size_t i = 1; i < v.size(); i++){
+		if(v[i - 1] > v[i]){
+			std::cout << "Not sorted" << std::endl;
+			return 1;
+		}
+	}
+	std::cout << "Sorted " << v.size() << " elements" << std::endl;
+	return 0;
+}